@@ -13,8 +13,16 @@
 
 #include <stdarg.h>
 
-/* counter for variable memory locations */
-static int location = 0;
+/* next free location for global variables
+ * (relative to gp) and in the activation record
+ * of the function being analyzed (relative to
+ * fp, growing down)
+ */
+static int globalOffset = 0;
+static int frameOffset = initFO;
+
+/* function being analyzed, for its frame size */
+static BucketList currentFunc = NULL;
 
 /* Procedure traverse is a generic recursive 
  * syntax tree traversal routine:
@@ -60,6 +68,26 @@ static void semanticError(TreeNode* t, const char* message, ...)
   Error = TRUE;
 }
 
+/* Procedure allocate assigns the memory location
+ * of variable l declared at t: compact globals,
+ * and frame locations for parameters and locals
+ */
+static void allocate( BucketList l, TreeNode * t)
+{ int size = 1;
+  if ((t->kind.stmt == VarDeclK) && (t->child[0] != NULL))
+    size = t->child[0]->attr.val;
+  if (l->scope->parent == NULL)
+  { l->memloc = globalOffset;
+    globalOffset += size;
+  }
+  else
+  { l->memloc = frameOffset - size + 1;
+    frameOffset -= size;
+    if (-frameOffset > currentFunc->func.frameSize)
+      currentFunc->func.frameSize = -frameOffset;
+  }
+} /* allocate */
+
 /* Procedure insertNode inserts 
  * identifiers stored in t into 
  * the symbol table 
@@ -84,7 +112,9 @@ static void insertNode( TreeNode * t)
             break;
           }
 
-          st_insert(currentScope, t->attr.name, t->type, t->lineno, t->lineno);
+          l = st_insert(currentScope, t->attr.name, t->type, t->lineno, 0);
+          l->isParam = (t->kind.stmt == ParamK);
+          allocate(l, t);
           break;
 
         case FuncDeclK:
@@ -96,7 +126,10 @@ static void insertNode( TreeNode * t)
 
           {
             TreeNode* param = t->child[0];
-            l = st_insert(currentScope, t->attr.name, Function, t->lineno, t->lineno);
+            l = st_insert(currentScope, t->attr.name, Function, t->lineno, 0);
+            l->func.frameSize = -initFO;
+            currentFunc = l;
+            frameOffset = initFO;
 
             l->func.type = t->type;
             if (param->type != Void)
@@ -113,6 +146,8 @@ static void insertNode( TreeNode * t)
             }
 
             ScopeList newScope = buildScope(t->attr.name, currentScope);
+            newScope->tree = t;
+            newScope->frameBase = initFO;
             addChildScope(currentScope, newScope);
             currentScope = newScope;
 
@@ -132,6 +167,8 @@ static void insertNode( TreeNode * t)
             sprintf(buf, "%s-%d", currentScope->name, t->lineno);
 
             ScopeList newScope = buildScope(buf, currentScope);
+            newScope->tree = t;
+            newScope->frameBase = frameOffset;
             addChildScope(currentScope, newScope);
             currentScope = newScope;
           }
@@ -162,7 +199,7 @@ static void insertNode( TreeNode * t)
               break;
             }
 
-            st_insert(l->scope, t->attr.name, l->type, t->lineno, t->lineno);
+            st_insert(l->scope, t->attr.name, l->type, t->lineno, 0);
           }
           break;
       }
@@ -174,17 +211,38 @@ static void afterInsertNode( TreeNode* t )
 {
   if (t->nodekind == StmtK && t->kind.stmt == CompoundK)
   {
+    /* sibling compound statements reuse the locations */
+    frameOffset = currentScope->frameBase;
     currentScope = currentScope->parent;
   }
 }
 
+/* Procedure printLayout prints the data memory
+ * taken by the globals and the activation record
+ * of each function
+ */
+static void printLayout(FILE * listing)
+{ extern ScopeList globalScope;
+  BucketList l;
+  int i;
+  fprintf(listing,"Global variables: %d words\n",globalOffset);
+  fprintf(listing,"Function Name  Frame Size\n");
+  fprintf(listing,"-------------  ----------\n");
+  for (i=0;i<HASH_TBL_SIZE;++i)
+    for (l = globalScope->bucket[i]; l != NULL; l = l->next)
+      if ((l->type == Function) && (l->func.frameSize > 0))
+        fprintf(listing,"%-14s %5d words\n",l->name,l->func.frameSize);
+} /* printLayout */
+
 /* Function buildSymtab constructs the symbol 
  * table by preorder traversal of the syntax tree
+ * and lays out the variables in memory
  */
 void buildSymtab(TreeNode * syntaxTree)
 { init_symtab();
   extern ScopeList globalScope;
   currentScope = globalScope;
+  globalOffset = 0;
   traverse(syntaxTree,insertNode,afterInsertNode);
   if (TraceAnalyze)
   { fprintf(listing,"\n< Symbol Table >\n");
@@ -195,6 +253,8 @@ void buildSymtab(TreeNode * syntaxTree)
     printFuncAndGlobalTab(listing);
     fprintf(listing,"\n< Local Variables >\n");
     printLocalVarTab(listing);
+    fprintf(listing,"\n< Memory Layout >\n");
+    printLayout(listing);
   }
 }
 
@@ -207,7 +267,7 @@ static void beforeCheckNode(TreeNode* t)
   {
     if (t->kind.stmt == FuncDeclK)
     {
-      currentScope = findScope(t->attr.name, currentScope);
+      currentScope = findScope(t, currentScope);
       func_decl_flag = 1;
     }
     else if (t->kind.stmt == CompoundK)
@@ -218,10 +278,7 @@ static void beforeCheckNode(TreeNode* t)
       }
       else
       {
-        char buf[256];
-        sprintf(buf, "%s-%d", currentScope->name, t->lineno);
-
-        currentScope = findScope(buf, currentScope);
+        currentScope = findScope(t, currentScope);
       }
     }
   }
@@ -0,0 +1,254 @@
+/****************************************************/
+/* File: callgraph.c                                */
+/* Call graph of the C-MINUS compiler: which        */
+/* functions call which, found from the FuncDeclK   */
+/* and CallK nodes, with the strongly connected     */
+/* components by Tarjan's algorithm. Every step is  */
+/* linear in the size of the tree.                  */
+/****************************************************/
+
+#include "globals.h"
+#include "callgraph.h"
+
+/* SHIFT is the power of two used as multiplier
+   in hash function  */
+#define SHIFT 4
+
+/* the hash function */
+static int hash ( char * key, int size )
+{ int temp = 0;
+  int i = 0;
+  while (key[i] != '\0')
+  { temp = ((temp << SHIFT) + key[i]) % size;
+    ++i;
+  }
+  return temp;
+}
+
+/* Procedure addNode adds function name declared
+ * at tree to the call graph g
+ */
+static void addNode( CallGraph g, char * name, TreeNode * tree)
+{ CallNode * n = &g->node[g->nnodes];
+  int h = hash(name,g->hashSize);
+  n->name = name;
+  n->tree = tree;
+  n->callee = NULL;
+  n->ncallees = 0;
+  n->scc = -1;
+  n->recursive = FALSE;
+  n->reachable = FALSE;
+  n->leaf = TRUE;
+  g->next[g->nnodes] = g->hash[h];
+  g->hash[h] = g->nnodes++;
+}
+
+/* Function cgLookup returns the index of function
+ * name in the call graph, or -1 if not found
+ */
+int cgLookup( CallGraph g, char * name)
+{ int i = g->hash[hash(name,g->hashSize)];
+  while ((i >= 0) && (strcmp(g->node[i].name,name) != 0))
+    i = g->next[i];
+  return i;
+}
+
+/* Procedure addCalls adds to function f the
+ * functions called in tree t. seen[j] is f when
+ * j is added already, so each is added once.
+ */
+static void addCalls( CallGraph g, int f, TreeNode * t, int * seen, int * max)
+{ int i, j;
+  for (; t != NULL; t = t->sibling)
+  { if ((t->nodekind == ExpK) && (t->kind.exp == CallK) &&
+        ((j = cgLookup(g,t->attr.name)) >= 0) && (seen[j] != f))
+    { CallNode * n = &g->node[f];
+      seen[j] = f;
+      if (n->ncallees == *max)
+      { *max = 2 * *max + 8;
+        n->callee = (int *) realloc(n->callee,*max * sizeof(int));
+      }
+      n->callee[n->ncallees++] = j;
+      if (g->node[j].tree != NULL) n->leaf = FALSE;
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+      addCalls(g,f,t->child[i],seen,max);
+  }
+}
+
+/* Procedure findSccs numbers the strongly
+ * connected components of g by Tarjan's
+ * algorithm, with explicit stacks so that long
+ * call chains cannot overflow the C stack
+ */
+static void findSccs( CallGraph g)
+{ int n = g->nnodes;
+  int * index = (int *) malloc(n * sizeof(int));
+  int * low = (int *) malloc(n * sizeof(int));
+  int * stack = (int *) malloc(n * sizeof(int));
+  int * frame = (int *) malloc(n * sizeof(int));
+  int * edge = (int *) malloc(n * sizeof(int));
+  char * onStack = (char *) calloc(n,sizeof(char));
+  int next = 0, sp = 0, fp, s, v, w, size;
+  for (v = 0; v < n; v++) index[v] = -1;
+  g->nsccs = 0;
+  for (s = 0; s < n; s++)
+  { if (index[s] >= 0) continue;
+    fp = 0;
+    frame[fp] = s;
+    edge[fp++] = 0;
+    index[s] = low[s] = next++;
+    stack[sp++] = s;
+    onStack[s] = TRUE;
+    while (fp > 0)
+    { v = frame[fp-1];
+      if (edge[fp-1] < g->node[v].ncallees)
+      { w = g->node[v].callee[edge[fp-1]++];
+        if (w == v) g->node[v].recursive = TRUE;
+        if (index[w] < 0)
+        { index[w] = low[w] = next++;
+          stack[sp++] = w;
+          onStack[w] = TRUE;
+          frame[fp] = w;
+          edge[fp++] = 0;
+        }
+        else if (onStack[w] && (index[w] < low[v]))
+          low[v] = index[w];
+        continue;
+      }
+      if (--fp > 0)
+      { w = frame[fp-1];
+        if (low[v] < low[w]) low[w] = low[v];
+      }
+      if (low[v] == index[v])
+      { size = 0;
+        do
+        { w = stack[--sp];
+          onStack[w] = FALSE;
+          g->node[w].scc = g->nsccs;
+          size++;
+        } while (w != v);
+        if (size > 1)
+          for (w = sp; w < sp + size; w++)
+            g->node[stack[w]].recursive = TRUE;
+        g->nsccs++;
+      }
+    }
+  }
+  free(index);
+  free(low);
+  free(stack);
+  free(frame);
+  free(edge);
+  free(onStack);
+}
+
+/* Procedure findReachable marks the functions
+ * main may call
+ */
+static void findReachable( CallGraph g)
+{ int * stack = (int *) malloc(g->nnodes * sizeof(int));
+  int sp = 0, v, i;
+  CallNode * n;
+  if ((v = cgLookup(g,"main")) < 0)
+  { free(stack);
+    return;
+  }
+  g->node[v].reachable = TRUE;
+  stack[sp++] = v;
+  while (sp > 0)
+  { n = &g->node[stack[--sp]];
+    for (i = 0; i < n->ncallees; i++)
+      if (! g->node[n->callee[i]].reachable)
+      { g->node[n->callee[i]].reachable = TRUE;
+        stack[sp++] = n->callee[i];
+      }
+  }
+  free(stack);
+}
+
+/* Function buildCallGraph builds the call graph of
+ * the checked syntax tree
+ */
+CallGraph buildCallGraph(TreeNode * syntaxTree)
+{ CallGraph g = (CallGraph) malloc(sizeof(*g));
+  TreeNode * t;
+  int n = 2, i, max;
+  int * seen;
+  for (t = syntaxTree; t != NULL; t = t->sibling)
+    if ((t->nodekind == StmtK) && (t->kind.stmt == FuncDeclK)) n++;
+  g->node = (CallNode *) malloc(n * sizeof(CallNode));
+  g->nnodes = 0;
+  g->nsccs = 0;
+  g->hashSize = 2 * n + 1;
+  g->hash = (int *) malloc(g->hashSize * sizeof(int));
+  g->next = (int *) malloc(n * sizeof(int));
+  for (i = 0; i < g->hashSize; i++) g->hash[i] = -1;
+  for (t = syntaxTree; t != NULL; t = t->sibling)
+    if ((t->nodekind == StmtK) && (t->kind.stmt == FuncDeclK))
+      addNode(g,t->attr.name,t);
+  addNode(g,"input",NULL);
+  addNode(g,"output",NULL);
+  seen = (int *) malloc(n * sizeof(int));
+  for (i = 0; i < n; i++) seen[i] = -1;
+  for (i = 0; i < g->nnodes; i++)
+    if (g->node[i].tree != NULL)
+    { max = 0;
+      addCalls(g,i,g->node[i].tree->child[1],seen,&max);
+    }
+  free(seen);
+  findSccs(g);
+  findReachable(g);
+  return g;
+}
+
+/* Procedure freeCallGraph frees the call graph */
+void freeCallGraph( CallGraph g)
+{ int i;
+  for (i = 0; i < g->nnodes; i++)
+    free(g->node[i].callee);
+  free(g->node);
+  free(g->hash);
+  free(g->next);
+  free(g);
+}
+
+/* Procedure printCallGraph writes the call graph
+ * to file f as a DOT digraph, or as JSON if json
+ * is TRUE
+ */
+void printCallGraph( CallGraph g, FILE * f, int json)
+{ int i, j;
+  CallNode * n;
+  if (json)
+  { fprintf(f,"{ \"functions\": [\n");
+    for (i = 0; i < g->nnodes; i++)
+    { n = &g->node[i];
+      fprintf(f,"  { \"name\": \"%s\", \"builtin\": %s, \"scc\": %d, ",
+              n->name,(n->tree == NULL) ? "true" : "false",n->scc);
+      fprintf(f,"\"recursive\": %s, \"reachable\": %s, \"leaf\": %s,\n",
+              n->recursive ? "true" : "false",n->reachable ? "true" : "false",
+              n->leaf ? "true" : "false");
+      fprintf(f,"    \"calls\": [");
+      for (j = 0; j < n->ncallees; j++)
+        fprintf(f,"%s\"%s\"",(j > 0) ? ", " : "",g->node[n->callee[j]].name);
+      fprintf(f,"] }%s\n",(i < g->nnodes - 1) ? "," : "");
+    }
+    fprintf(f,"] }\n");
+  }
+  else
+  { fprintf(f,"digraph callgraph {\n");
+    for (i = 0; i < g->nnodes; i++)
+    { n = &g->node[i];
+      fprintf(f,"  \"%s\" [shape=%s",n->name,(n->tree == NULL) ? "ellipse" : "box");
+      if (n->recursive) fprintf(f,", color=red");
+      if (! n->reachable) fprintf(f,", style=dashed");
+      fprintf(f,"];\n");
+    }
+    for (i = 0; i < g->nnodes; i++)
+      for (j = 0; j < g->node[i].ncallees; j++)
+        fprintf(f,"  \"%s\" -> \"%s\";\n",g->node[i].name,
+                g->node[g->node[i].callee[j]].name);
+    fprintf(f,"}\n");
+  }
+}
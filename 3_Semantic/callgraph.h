@@ -0,0 +1,56 @@
+/****************************************************/
+/* File: callgraph.h                                */
+/* Call graph interface for the C-MINUS compiler    */
+/****************************************************/
+
+#ifndef _CALLGRAPH_H_
+#define _CALLGRAPH_H_
+
+/* The record of one function in the call graph.
+ * Strongly connected components are numbered
+ * callees first: a function only calls functions
+ * of its own component or of lower numbers.
+ */
+typedef struct
+   { char * name;
+     TreeNode * tree; /* FuncDeclK, NULL for input and output */
+     int * callee;    /* indices of the functions called, once each */
+     int ncallees;
+     int scc;         /* strongly connected component */
+     int recursive;   /* TRUE if it may call itself */
+     int reachable;   /* TRUE if main may call it */
+     int leaf;        /* TRUE if it calls no function but builtins */
+   } CallNode;
+
+typedef struct
+   { CallNode * node; /* declared functions in source order, then builtins */
+     int nnodes;
+     int nsccs;
+     int * hash;      /* name hash table: first node of each chain */
+     int * next;      /* next node in the same chain */
+     int hashSize;
+   } * CallGraph;
+
+/* Function buildCallGraph builds the call graph of
+ * the checked syntax tree: the calls of every
+ * function, its recursion, whether main reaches it
+ * and whether it is a leaf. It takes time linear
+ * in the size of the tree.
+ */
+CallGraph buildCallGraph(TreeNode *);
+
+/* Function cgLookup returns the index of function
+ * name in the call graph, or -1 if not found
+ */
+int cgLookup(CallGraph, char * name);
+
+/* Procedure freeCallGraph frees the call graph */
+void freeCallGraph(CallGraph);
+
+/* Procedure printCallGraph writes the call graph
+ * to file f as a DOT digraph, or as JSON if json
+ * is TRUE
+ */
+void printCallGraph(CallGraph, FILE * f, int json);
+
+#endif
@@ -0,0 +1,501 @@
+/****************************************************/
+/* File: ccgen.c                                    */
+/* The code generator implementation for the        */
+/* C-MINUS compiler that generates a C program:     */
+/* every function, variable and statement maps to   */
+/* its C counterpart, with #line markers giving the */
+/* C-MINUS source lines                             */
+/****************************************************/
+
+#include <stdarg.h>
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include "ccgen.h"
+
+/* C-MINUS names get the prefix cm_, so they
+ * cannot clash with C keywords or the runtime;
+ * temporaries are named tmp<n>.
+ *
+ * The C program behaves like the TM code:
+ * arithmetic wraps around, a comparison takes
+ * the sign of the wrapped difference, division
+ * by 0 ends the run as in tm --run, and
+ * operands are evaluated left to right. C
+ * leaves the order of operands open, so when
+ * one of them has a side effect the left one
+ * is saved first in a temporary:
+ * (tmp1 = a, tmp1 + f()).
+ */
+
+/* runtime of the generated program: batch I/O
+ * and the division by 0 exit, as in cmrt.c
+ */
+static char * runtime[] = {
+"#include <stdio.h>",
+"#include <stdlib.h>",
+"#include <ctype.h>",
+"#include <limits.h>",
+"",
+"static void cm_fault ( int res, const char * msg )",
+"{ fflush(stdout);",
+"  fprintf(stderr, \"%s\\n\", msg);",
+"  exit(res);",
+"}",
+"",
+"static int cm_input ( void )",
+"{ unsigned int v = 0;",
+"  int c, neg = 0;",
+"  do c = getchar_unlocked(); while ( (c != EOF) && isspace(c) );",
+"  if ( (c == '-') || (c == '+') )",
+"  { neg = (c == '-');",
+"    c = getchar_unlocked();",
+"  }",
+"  if ( (c == EOF) || ! isdigit(c) ) cm_fault(5, \"Input Error\");",
+"  do",
+"  { v = v * 10 + (c - '0');",
+"    c = getchar_unlocked();",
+"  } while ( (c != EOF) && isdigit(c) );",
+"  if ( c != EOF ) ungetc(c, stdin);",
+"  return (int) (neg ? -v : v);",
+"}",
+"",
+"static void cm_output ( int val )",
+"{ char digits[12];",
+"  unsigned int v = (val < 0) ? - (unsigned int) val : (unsigned int) val;",
+"  int n = 0;",
+"  do",
+"  { digits[n++] = '0' + v % 10;",
+"    v /= 10;",
+"  } while ( v != 0 );",
+"  if ( val < 0 ) putchar_unlocked('-');",
+"  while ( n > 0 ) putchar_unlocked(digits[--n]);",
+"  putchar_unlocked('\\n');",
+"}",
+"",
+"static inline int cm_div ( int a, int b )",
+"{ if ( b == 0 ) cm_fault(4, \"Division by 0\");",
+"  if ( (b == -1) && (a == INT_MIN) ) cm_fault(9, \"Division Overflow\");",
+"  return a / b;",
+"}",
+NULL };
+
+/* the C program, or the buffer for the body of
+ * the function being generated
+ */
+static FILE * out;
+
+/* names of the C-MINUS source and of the code file */
+static char * srcName;
+static char * codeName;
+
+/* outLine is the line of the code file being
+ * written; srcLine is the source line the C
+ * compiler takes it for after the last #line,
+ * 0 if unknown
+ */
+static int outLine = 1;
+static int srcLine = 0;
+
+/* last temporary used in the current function */
+static int tmpNo = 0;
+
+/* prototype for internal recursive code generator */
+static void genExp( TreeNode * tree);
+
+static void emit( char * fmt, ...)
+{ va_list ap;
+  va_start(ap,fmt);
+  vfprintf(out,fmt,ap);
+  va_end(ap);
+} /* emit */
+
+/* Procedure endLine ends the line of code */
+static void endLine(void)
+{ fputc('\n',out);
+  outLine++;
+  if (srcLine > 0) srcLine++;
+} /* endLine */
+
+/* Procedure startLine starts a line of code at
+ * indentation level indent for source line
+ * lineno, after a #line marker if needed
+ */
+static void startLine( int indent, int lineno)
+{ if ((lineno > 0) && (lineno != srcLine))
+  { fprintf(out,"#line %d \"%s\"",lineno,srcName);
+    srcLine = lineno;
+    fputc('\n',out);
+    outLine++;
+  }
+  fprintf(out,"%*s",2 * indent,"");
+} /* startLine */
+
+/* Function hasEffects returns TRUE if evaluating
+ * tree may assign, read input or call
+ */
+static int hasEffects( TreeNode * tree)
+{ int i;
+  if (tree == NULL) return FALSE;
+  if ((tree->nodekind == ExpK) &&
+      ((tree->kind.exp == AssignK) || (tree->kind.exp == CallK)))
+    return TRUE;
+  for (i = 0; i < MAXCHILDREN; i++)
+    if (hasEffects(tree->child[i])) return TRUE;
+  return FALSE;
+} /* hasEffects */
+
+/* Function isFixed returns TRUE if tree has the
+ * same value whenever it is evaluated: a
+ * constant or the address of an array
+ */
+static int isFixed( TreeNode * tree)
+{ return (tree->kind.exp == ConstK) ||
+         ((tree->kind.exp == VarAccessK) && (tree->child[0] == NULL) &&
+          (tree->type == IntegerArr));
+} /* isFixed */
+
+/* Function ordered returns TRUE if left and
+ * right give the same values in either order
+ */
+static int ordered( TreeNode * left, TreeNode * right)
+{ return (isFixed(left) || ! hasEffects(right)) &&
+         (isFixed(right) || ! hasEffects(left));
+} /* ordered */
+
+/* Procedure genBinary generates the operation
+ * of tree: fmt takes the left and right
+ * operands as two %s
+ */
+static void genBinary( TreeNode * tree, char * fmt)
+{ char * left = strstr(fmt,"%s");
+  char * right = strstr(left + 2,"%s");
+  int t = 0;
+  if (! ordered(tree->child[0],tree->child[1]))
+  { t = ++tmpNo;
+    emit("(tmp%d = ",t);
+    genExp(tree->child[0]);
+    emit(", ");
+  }
+  fwrite(fmt,1,left - fmt,out);
+  if (t > 0) emit("tmp%d",t);
+  else genExp(tree->child[0]);
+  fwrite(left + 2,1,right - left - 2,out);
+  genExp(tree->child[1]);
+  emit("%s",right + 2);
+  if (t > 0) emit(")");
+} /* genBinary */
+
+/* Procedure genCall generates the call tree.
+ * When an argument has a side effect, the ones
+ * before the last that can change are saved in
+ * temporaries first.
+ */
+static void genCall( TreeNode * tree)
+{ TreeNode * p, * last = NULL;
+  int tmp[MAX_FUNC_PARAMS];
+  int effects = FALSE, i, n = 0;
+  for (p = tree->child[0]; p != NULL; p = p->sibling)
+  { if (hasEffects(p)) effects = TRUE;
+    if (! isFixed(p))
+    { last = p;
+      n++;
+    }
+  }
+  if (effects && (n > 1))
+  { emit("(");
+    for (i = 0, p = tree->child[0]; p != last; i++, p = p->sibling)
+      if (! isFixed(p))
+      { tmp[i] = ++tmpNo;
+        emit("tmp%d = ",tmp[i]);
+        genExp(p);
+        emit(", ");
+      }
+  }
+  else last = NULL;
+  emit("cm_%s(",tree->attr.name);
+  for (i = 0, p = tree->child[0]; p != NULL; i++, p = p->sibling)
+  { if ((last != NULL) && (p != last) && ! isFixed(p))
+      emit("tmp%d",tmp[i]);
+    else genExp(p);
+    if (p->sibling != NULL) emit(", ");
+  }
+  emit(")");
+  if (last != NULL) emit(")");
+} /* genCall */
+
+/* Procedure genExp generates code at an expression node */
+static void genExp( TreeNode * tree)
+{ TreeNode * p1, * p2;
+  int t;
+  switch (tree->kind.exp) {
+
+    case ConstK :
+      /* folding may leave negative constants */
+      if (tree->attr.val == (int) (1u << 31)) emit("(-2147483647 - 1)");
+      else if (tree->attr.val < 0) emit("(%d)",tree->attr.val);
+      else emit("%d",tree->attr.val);
+      break; /* ConstK */
+
+    case VarAccessK :
+      emit("cm_%s",tree->attr.name);
+      if (tree->child[0] != NULL)
+      { emit("[");
+        genExp(tree->child[0]);
+        emit("]");
+      }
+      break; /* VarAccessK */
+
+    case AssignK :
+      p1 = tree->child[0];
+      p2 = tree->child[1];
+      if ((p1->child[0] != NULL) && ! ordered(p1->child[0],p2))
+      { /* the index comes first */
+        t = ++tmpNo;
+        emit("(tmp%d = ",t);
+        genExp(p1->child[0]);
+        emit(", cm_%s[tmp%d] = ",p1->attr.name,t);
+      }
+      else
+      { emit("(");
+        genExp(p1);
+        emit(" = ");
+      }
+      genExp(p2);
+      emit(")");
+      break; /* AssignK */
+
+    case CallK :
+      genCall(tree);
+      break; /* CallK */
+
+    case OpK :
+      switch (tree->attr.op) {
+        /* unsigned arithmetic wraps around as TM's */
+        case PLUS : genBinary(tree,"(int) ((unsigned) %s + %s)"); break;
+        case MINUS : genBinary(tree,"(int) ((unsigned) %s - %s)"); break;
+        case TIMES : genBinary(tree,"(int) ((unsigned) %s * %s)"); break;
+        case OVER : genBinary(tree,"cm_div(%s, %s)"); break;
+        /* TM compares by the sign of the wrapped difference */
+        case LT : genBinary(tree,"((int) ((unsigned) %s - %s) < 0)"); break;
+        case LE : genBinary(tree,"((int) ((unsigned) %s - %s) <= 0)"); break;
+        case GT : genBinary(tree,"((int) ((unsigned) %s - %s) > 0)"); break;
+        case GE : genBinary(tree,"((int) ((unsigned) %s - %s) >= 0)"); break;
+        case EQ : genBinary(tree,"(%s == %s)"); break;
+        case NE : genBinary(tree,"(%s != %s)"); break;
+        default: emit("/* BUG: Unknown operator */ 0"); break;
+      }
+      break; /* OpK */
+
+    default:
+      break;
+  }
+} /* genExp */
+
+/* Procedure genDecl generates the declaration at t */
+static void genDecl( TreeNode * t, int indent, char * storage)
+{ startLine(indent,t->lineno);
+  emit("%sint cm_%s",storage,t->attr.name);
+  if (t->child[0] != NULL) emit("[%d]",t->child[0]->attr.val);
+  emit(";");
+  endLine();
+} /* genDecl */
+
+static void genStmts( TreeNode * tree, int indent);
+
+/* Procedure genBody generates the statement tree
+ * as the body of an if or while, in braces so an
+ * else cannot attach to a nested if; tree is
+ * NULL for a body removed as dead code
+ */
+static void genBody( TreeNode * tree, int indent)
+{ if ((tree != NULL) && (tree->nodekind == StmtK) &&
+      (tree->kind.stmt == CompoundK))
+    genStmts(tree,indent);
+  else
+  { startLine(indent,0);
+    emit("{");
+    endLine();
+    genStmts(tree,indent + 1);
+    startLine(indent,0);
+    emit("}");
+    endLine();
+  }
+} /* genBody */
+
+/* Procedure genStmt generates code at a statement node */
+static void genStmt( TreeNode * tree, int indent)
+{ TreeNode * p;
+  switch (tree->nodekind) {
+    case ExpK :
+      startLine(indent,tree->lineno);
+      if ((tree->kind.exp != AssignK) && (tree->kind.exp != CallK))
+        emit("(void) ");
+      genExp(tree);
+      emit(";");
+      endLine();
+      return;
+    default :
+      break;
+  }
+  switch (tree->kind.stmt) {
+
+      case VarDeclK :
+         genDecl(tree,indent,"");
+         break; /* VarDeclK */
+
+      case CompoundK :
+         startLine(indent,0);
+         emit("{");
+         endLine();
+         for (p = tree->child[0]; p != NULL; p = p->sibling)
+           genDecl(p,indent + 1,"");
+         genStmts(tree->child[1],indent + 1);
+         startLine(indent,0);
+         emit("}");
+         endLine();
+         break; /* CompoundK */
+
+      case IfK :
+      case IfElseK :
+         startLine(indent,sourceLine(tree));
+         emit("if (");
+         genExp(tree->child[0]);
+         emit(")");
+         endLine();
+         genBody(tree->child[1],indent);
+         if (tree->child[2] != NULL)
+         { startLine(indent,0);
+           emit("else");
+           endLine();
+           genBody(tree->child[2],indent);
+         }
+         break; /* if_k */
+
+      case WhileK :
+         startLine(indent,sourceLine(tree));
+         emit("while (");
+         genExp(tree->child[0]);
+         emit(")");
+         endLine();
+         genBody(tree->child[1],indent);
+         break; /* while */
+
+      case ReturnK :
+         startLine(indent,tree->lineno);
+         if (tree->child[0] == NULL) emit("return;");
+         else
+         { emit("return ");
+           genExp(tree->child[0]);
+           emit(";");
+         }
+         endLine();
+         break; /* return */
+
+      default:
+         break;
+    }
+} /* genStmt */
+
+/* Procedure genStmts generates the statement
+ * list tree
+ */
+static void genStmts( TreeNode * tree, int indent)
+{ for (; tree != NULL; tree = tree->sibling)
+    genStmt(tree,indent);
+} /* genStmts */
+
+/* Procedure genFunction generates the function
+ * declared at tree. The body is generated first
+ * to learn the temporaries it needs.
+ */
+static void genFunction( TreeNode * tree)
+{ FILE * saved = out;
+  char * body;
+  size_t bodyLen;
+  TreeNode * p;
+  int i, bodyLines, bodySrcLine;
+  tmpNo = 0;
+  out = open_memstream(&body,&bodyLen);
+  srcLine = 0;
+  bodyLines = outLine;
+  for (p = tree->child[1]->child[0]; p != NULL; p = p->sibling)
+    genDecl(p,1,"");
+  genStmts(tree->child[1]->child[1],1);
+  fclose(out);
+  out = saved;
+  bodySrcLine = srcLine;
+  bodyLines = outLine - bodyLines;
+  outLine -= bodyLines;
+  /* the header */
+  srcLine = 0;
+  startLine(0,tree->lineno);
+  emit("static %s cm_%s(",(tree->type == Void) ? "void" : "int",tree->attr.name);
+  for (p = tree->child[0]; p != NULL; p = p->sibling)
+  { if (p->kind.stmt != ParamK)
+      emit("void");
+    else if (p->type == IntegerArr)
+      emit("int * cm_%s",p->attr.name);
+    else
+      emit("int cm_%s",p->attr.name);
+    if (p->sibling != NULL) emit(", ");
+  }
+  emit(")");
+  endLine();
+  emit("{");
+  endLine();
+  if (tmpNo > 0)
+  { emit("  int tmp1");
+    for (i = 2; i <= tmpNo; i++) emit(", tmp%d",i);
+    emit(";");
+    endLine();
+  }
+  fwrite(body,1,bodyLen,out);
+  free(body);
+  outLine += bodyLines;
+  srcLine = bodySrcLine;
+  emit("}");
+  endLine();
+} /* genFunction */
+
+/**********************************************/
+/* the primary function of the code generator */
+/**********************************************/
+/* Procedure ccGen generates a C program to the
+ * code file by traversal of the syntax tree.
+ * codefile is the name of the code file and
+ * srcfile the name of the source, for the
+ * #line markers.
+ */
+void ccGen(TreeNode * syntaxTree, char * codefile, char * srcfile)
+{  TreeNode * t;
+   int i;
+   out = code;
+   srcName = srcfile;
+   codeName = codefile;
+   emit("/* C-MINUS Compilation to C Code */");
+   endLine();
+   emit("/* File: %s */",codefile);
+   endLine();
+   for (i = 0; runtime[i] != NULL; i++)
+   { emit("%s",runtime[i]);
+     endLine();
+   }
+   endLine();
+   for (t = syntaxTree; t != NULL; t = t->sibling)
+     if (t->kind.stmt == FuncDeclK) genFunction(t);
+     else genDecl(t,0,"static ");
+   /* back to the lines of the code file */
+   emit("#line %d \"%s\"",outLine + 1,codeName);
+   endLine();
+   emit("int main ( void )");
+   endLine();
+   emit("{ cm_main();");
+   endLine();
+   emit("  fflush(stdout);");
+   endLine();
+   emit("  return 0;");
+   endLine();
+   emit("}");
+   endLine();
+}
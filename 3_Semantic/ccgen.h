@@ -0,0 +1,19 @@
+/*******************************************************/
+/* File: ccgen.h                                       */
+/* The C code generator interface to the C-MINUS       */
+/* compiler                                            */
+/*******************************************************/
+
+#ifndef _CCGEN_H_
+#define _CCGEN_H_
+
+/* Procedure ccGen generates a C program with
+ * the behavior of the TM code to the code file
+ * by traversal of the syntax tree. codefile is
+ * the name of the code file and srcfile the
+ * name of the source, for the #line markers.
+ * The program needs no runtime of its own.
+ */
+void ccGen(TreeNode * syntaxTree, char * codefile, char * srcfile);
+
+#endif
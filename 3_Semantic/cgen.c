@@ -7,8 +7,11 @@
 /* Kenneth C. Louden                                */
 /****************************************************/
 
+#include <limits.h>
 #include "globals.h"
+#include "util.h"
 #include "symtab.h"
+#include "loopinfo.h"
 #include "code.h"
 #include "cgen.h"
 
@@ -18,77 +21,547 @@
 */
 static int tmpOffset = 0;
 
-/* prototype for internal recursive code generator */
+/* scope of the code being generated */
+static ScopeList currentScope;
+
+/* function being generated, its scope and the
+   location of its body, after the return address
+   is stored, where self tail calls jump to
+*/
+static TreeNode * currentFunc;
+static ScopeList funcScope;
+static int bodyLoc;
+
+/* An element address kept in a register by the
+   innermost loop being generated: the address of
+   array[index], where index is k*iv+a for a basic
+   induction variable iv and a loop invariant a.
+   It moves by inc when the statement step adds
+   to iv.
+*/
+typedef struct
+   { BucketList array;
+     TreeNode * index;
+     TreeNode * step;
+     int inc;
+   } IndPtr;
+static IndPtr indPtr[NPTRREGS];
+static int nindPtrs = 0;
+
+/* basic induction variables of the loop, each
+   assigned once in it, by a top level statement
+   step adding the constant c
+*/
+typedef struct
+   { BucketList var;
+     TreeNode * step;
+     int c;
+   } IndVar;
+static IndVar * indVar = NULL;
+static int nindVars = 0, maxIndVars = 0;
+
+/* the loop whose induction variables are found */
+static LoopInfo loop;
+
+/* prototypes for internal recursive code generator */
 static void cGen (TreeNode * tree);
+static void genExp (TreeNode * tree);
+
+/* Procedure genDecl moves the temps below the
+ * local variable declared at t; buildSymtab has
+ * assigned its location
+ */
+static void genDecl( TreeNode * t)
+{ BucketList l = st_lookup(currentScope,t->attr.name);
+  if ((l->scope->parent != NULL) && (l->memloc <= tmpOffset))
+    tmpOffset = l->memloc - 1;
+} /* genDecl */
+
+/* Function baseReg returns the register
+ * variable l is addressed relative to
+ */
+static int baseReg( BucketList l)
+{ return (l->scope->parent == NULL) ? gp : fp; }
+
+/* Procedure genArrayBase loads the absolute
+ * address of element 0 of array l into reg
+ */
+static void genArrayBase( BucketList l, int reg)
+{ if (l->isParam)
+    emitRM("LD",reg,l->memloc,fp,"load array parameter address");
+  else
+    emitRM("LDA",reg,l->memloc,baseReg(l),"load array address");
+} /* genArrayBase */
+
+/* Procedure genElemAddr computes the absolute
+ * address of the indexed variable tree into ac
+ */
+static void genElemAddr( TreeNode * tree)
+{ BucketList l = st_lookup(currentScope,tree->attr.name);
+  cGen(tree->child[0]);
+  genArrayBase(l,ac1);
+  emitRO("ADD",ac,ac1,ac,"compute element address");
+} /* genElemAddr */
+
+/* Procedure genReturn generates the epilogue
+ * returning from the current activation record
+ */
+static void genReturn(void)
+{ emitRM("LD",ac1,retFO,fp,"return: load return address");
+  emitRM("LD",fp,ofpFO,fp,"return: restore caller frame");
+  emitRM("LDA",pc,0,ac1,"return: jump back to caller");
+} /* genReturn */
+
+/* Function isTailCall returns TRUE if tree, the
+ * expression of a return statement, calls the
+ * function being generated and passes it none of
+ * its local arrays, which the reused activation
+ * record would overwrite
+ */
+static int isTailCall( TreeNode * tree)
+{ TreeNode * a;
+  BucketList l;
+  if ((tree == NULL) || (tree->nodekind != ExpK) ||
+      (tree->kind.exp != CallK) ||
+      (strcmp(tree->attr.name,currentFunc->attr.name) != 0))
+    return FALSE;
+  for (a = tree->child[0]; a != NULL; a = a->sibling)
+    if ((a->kind.exp == VarAccessK) && (a->child[0] == NULL) &&
+        ((l = st_lookup(currentScope,a->attr.name)) != NULL) &&
+        (l->type == IntegerArr) && ! l->isParam && (l->scope->parent != NULL))
+      return FALSE;
+  return TRUE;
+} /* isTailCall */
+
+/* Function hasAssign returns TRUE if the
+ * expression list tree assigns any variable
+ */
+static int hasAssign( TreeNode * tree)
+{ int i;
+  for (; tree != NULL; tree = tree->sibling)
+  { if ((tree->nodekind == ExpK) && (tree->kind.exp == AssignK))
+      return TRUE;
+    for (i = 0; i < MAXCHILDREN; i++)
+      if (hasAssign(tree->child[i])) return TRUE;
+  }
+  return FALSE;
+} /* hasAssign */
+
+/* Function isOwnParam returns TRUE if argument a
+ * is the value parameter p itself, so that it
+ * needs no move in a tail call
+ */
+static int isOwnParam( TreeNode * a, TreeNode * p)
+{ return (a->nodekind == ExpK) && (a->kind.exp == VarAccessK) &&
+         (a->child[0] == NULL) &&
+         (st_lookup(currentScope,a->attr.name) == st_lookup(funcScope,p->attr.name));
+} /* isOwnParam */
+
+/* Procedure genTailCall generates the self tail
+ * call tree as a jump to the function body. The
+ * arguments are evaluated to temps and then
+ * stored into the parameters of the current
+ * activation record, so the stack does not grow.
+ * The last argument goes from ac to its parameter
+ * directly.
+ */
+static void genTailCall( TreeNode * tree)
+{ TreeNode * a, * p, * last = NULL;
+  int keep = ! hasAssign(tree->child[0]);
+  int savedOffset = tmpOffset;
+  int offset = tmpOffset;
+  if (TraceCode) emitComment("-> tail call") ;
+  for (a = tree->child[0], p = currentFunc->child[0]; a != NULL;
+       a = a->sibling, p = p->sibling)
+    if (! (keep && isOwnParam(a,p))) last = a;
+  for (a = tree->child[0], p = currentFunc->child[0]; a != last;
+       a = a->sibling, p = p->sibling)
+    if (! (keep && isOwnParam(a,p)))
+    { genExp(a);
+      emitRM("ST",ac,tmpOffset--,fp,"tail call: push argument");
+    }
+  if (last != NULL)
+  { genExp(last);
+    emitRM("ST",ac,st_lookup(funcScope,p->attr.name)->memloc,fp,
+           "tail call: store parameter");
+  }
+  for (a = tree->child[0], p = currentFunc->child[0]; a != last;
+       a = a->sibling, p = p->sibling)
+    if (! (keep && isOwnParam(a,p)))
+    { emitRM("LD",ac,offset--,fp,"tail call: load argument");
+      emitRM("ST",ac,st_lookup(funcScope,p->attr.name)->memloc,fp,
+             "tail call: store parameter");
+    }
+  tmpOffset = savedOffset;
+  emitRM_Abs("LDA",pc,bodyLoc,"tail call: jump to body");
+  if (TraceCode) emitComment("<- tail call") ;
+} /* genTailCall */
+
+/* Procedure genMulConst multiplies ac by the
+ * constant c, by an add chain for 2, 3 and 4
+ */
+static void genMulConst( int c)
+{ switch (c) {
+    case 2 :
+      emitRO("ADD",ac,ac,ac,"op * 2");
+      break;
+    case 3 :
+      emitRO("ADD",ac1,ac,ac,"op * 3: double");
+      emitRO("ADD",ac,ac1,ac,"op * 3: add");
+      break;
+    case 4 :
+      emitRO("ADD",ac,ac,ac,"op * 4: double");
+      emitRO("ADD",ac,ac,ac,"op * 4: double");
+      break;
+    default :
+      emitRM("LDC",ac1,c,0,"op *: load const");
+      emitRO("MUL",ac,ac,ac1,"op *");
+      break;
+  }
+} /* genMulConst */
+
+/* Function genConstOp generates the operation
+ * tree if it adds, subtracts or multiplies by a
+ * constant, without pushing the other operand,
+ * and returns TRUE; it returns FALSE otherwise
+ */
+static int genConstOp( TreeNode * tree)
+{ TreeNode * e = tree->child[0], * c = tree->child[1];
+  int op = tree->attr.op;
+  if (((op == PLUS) || (op == TIMES)) &&
+      (e->nodekind == ExpK) && (e->kind.exp == ConstK))
+  { e = tree->child[1];
+    c = tree->child[0];
+  }
+  if ((c->nodekind != ExpK) || (c->kind.exp != ConstK) ||
+      ((op != PLUS) && (op != MINUS) && (op != TIMES)) ||
+      ((op == MINUS) && (c->attr.val == INT_MIN)))
+    return FALSE;
+  if (TraceCode) emitComment("-> Op const") ;
+  cGen(e);
+  switch (op) {
+    case PLUS :
+      emitRM("LDA",ac,c->attr.val,ac,"op + const");
+      break;
+    case MINUS :
+      emitRM("LDA",ac,-c->attr.val,ac,"op - const");
+      break;
+    default :
+      genMulConst(c->attr.val);
+      break;
+  }
+  if (TraceCode) emitComment("<- Op const") ;
+  return TRUE;
+} /* genConstOp */
+
+/* Procedure findIndVar records statement t, in
+ * scope, if it is "v = v + c", "v = c + v" or
+ * "v = v - c" for a variable v the loop assigns
+ * only there
+ */
+static void findIndVar( TreeNode * t, ScopeList scope)
+{ TreeNode * e, * v, * c;
+  BucketList l;
+  if ((t->nodekind != ExpK) || (t->kind.exp != AssignK) ||
+      ((l = loopVar(t->child[0],scope,&loop)) == NULL) || (timesAssigned(&loop,l) != 1))
+    return;
+  e = t->child[1];
+  if ((e->kind.exp != OpK) || ((e->attr.op != PLUS) && (e->attr.op != MINUS)))
+    return;
+  v = e->child[0];
+  c = e->child[1];
+  if ((e->attr.op == PLUS) && (v->kind.exp == ConstK))
+  { v = e->child[1];
+    c = e->child[0];
+  }
+  if ((c->kind.exp != ConstK) || (loopVar(v,scope,&loop) != l) ||
+      ((e->attr.op == MINUS) && (c->attr.val == INT_MIN)))
+    return;
+  if (nindVars == maxIndVars)
+  { maxIndVars = 2 * maxIndVars + 8;
+    indVar = (IndVar *) realloc(indVar,maxIndVars * sizeof(IndVar));
+  }
+  indVar[nindVars].var = l;
+  indVar[nindVars].step = t;
+  indVar[nindVars++].c = (e->attr.op == MINUS) ? - c->attr.val : c->attr.val;
+} /* findIndVar */
+
+/* Function linearIn returns the induction
+ * variable the index t, in scope, is k*iv+a of,
+ * with k in *k, or -1 if it is not
+ */
+static int linearIn( TreeNode * t, ScopeList scope, int * k)
+{ BucketList l;
+  TreeNode * c, * v;
+  int i;
+  if (t->kind.exp == VarAccessK)
+  { if ((l = loopVar(t,scope,&loop)) == NULL) return -1;
+    for (i = 0; i < nindVars; i++)
+      if (indVar[i].var == l)
+      { *k = 1;
+        return i;
+      }
+    return -1;
+  }
+  if (t->kind.exp != OpK) return -1;
+  switch (t->attr.op) {
+    case TIMES :
+      c = t->child[0];
+      v = t->child[1];
+      if (v->kind.exp == ConstK)
+      { c = t->child[1];
+        v = t->child[0];
+      }
+      if ((c->kind.exp != ConstK) || (v->kind.exp != VarAccessK) ||
+          ((i = linearIn(v,scope,k)) < 0))
+        return -1;
+      *k = c->attr.val;
+      return i;
+    case PLUS :
+      if (isLoopInvariant(t->child[0],scope,&loop))
+        return linearIn(t->child[1],scope,k);
+      if (isLoopInvariant(t->child[1],scope,&loop))
+        return linearIn(t->child[0],scope,k);
+      return -1;
+    case MINUS :
+      if (isLoopInvariant(t->child[1],scope,&loop))
+        return linearIn(t->child[0],scope,k);
+      return -1;
+    default :
+      return -1;
+  }
+} /* linearIn */
+
+/* Function findIndPtr returns the register
+ * holding the address of the indexed variable t
+ * in the current scope, or -1
+ */
+static int findIndPtr( TreeNode * t, ScopeList scope)
+{ BucketList l = st_lookup(scope,t->attr.name);
+  int i, k;
+  for (i = 0; i < nindPtrs; i++)
+    if ((indPtr[i].array == l) && sameExp(t->child[0],indPtr[i].index) &&
+        (linearIn(t->child[0],scope,&k) >= 0))
+      return pr + i;
+  return -1;
+} /* findIndPtr */
+
+/* Procedure findIndPtrs chooses the indexed
+ * variables of tree t and its siblings, in
+ * scope, whose addresses are kept in registers
+ */
+static void findIndPtrs( TreeNode * t, ScopeList scope)
+{ BucketList l;
+  ScopeList s;
+  int i, k;
+  for (; t != NULL; t = t->sibling)
+  { s = scope;
+    if ((t->nodekind == StmtK) && (t->kind.stmt == CompoundK))
+      s = findScope(t,scope);
+    else if ((t->nodekind == ExpK) && (t->kind.exp == VarAccessK) &&
+             (t->child[0] != NULL) && (nindPtrs < NPTRREGS) &&
+             ((l = st_lookup(scope,t->attr.name)) == st_lookup(loop.scope,t->attr.name)) &&
+             (findIndPtr(t,scope) < 0) && ((i = linearIn(t->child[0],scope,&k)) >= 0))
+    { indPtr[nindPtrs].array = l;
+      indPtr[nindPtrs].index = t->child[0];
+      indPtr[nindPtrs].step = indVar[i].step;
+      indPtr[nindPtrs++].inc = (int) ((unsigned) k * (unsigned) indVar[i].c);
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+      findIndPtrs(t->child[i],s);
+  }
+} /* findIndPtrs */
+
+/* Procedure genIndPtrs finds the induction
+ * variables of the innermost while loop tree
+ * without calls and loads the element addresses
+ * they index into registers before the loop
+ */
+static void genIndPtrs( TreeNode * tree)
+{ TreeNode * body = tree->child[1], * t;
+  ScopeList scope = currentScope;
+  int i;
+  nindPtrs = 0;
+  nindVars = 0;
+  scanLoop(tree,scope,&loop);
+  if (loop.calls || loop.loops) return;
+  if ((body->nodekind == StmtK) && (body->kind.stmt == CompoundK))
+  { scope = findScope(body,scope);
+    body = body->child[1];
+  }
+  for (t = body; t != NULL; t = t->sibling)
+    findIndVar(t,scope);
+  if (nindVars == 0) return;
+  findIndPtrs(tree->child[0],currentScope);
+  findIndPtrs(tree->child[1],currentScope);
+  for (i = 0; i < nindPtrs; i++)
+  { if (TraceCode) emitComment("-> induction pointer") ;
+    cGen(indPtr[i].index);
+    genArrayBase(indPtr[i].array,ac1);
+    emitRO("ADD",pr+i,ac1,ac,"loop: load element address");
+    if (TraceCode) emitComment("<- induction pointer") ;
+  }
+} /* genIndPtrs */
+
+/* Procedure genIndSteps moves the element
+ * addresses that the statement t steps
+ */
+static void genIndSteps( TreeNode * t)
+{ int i;
+  for (i = 0; i < nindPtrs; i++)
+    if (indPtr[i].step == t)
+      emitRM("LDA",pr+i,indPtr[i].inc,pr+i,"loop: step element address");
+} /* genIndSteps */
+
+/* Function genCond generates code for the test
+ * expression tree and reserves one location for
+ * the branch taken when the test is false.
+ * A relational test compiles to SUB plus the
+ * inverted conditional jump, so no 0/1 value
+ * is materialized. The reserved location is
+ * stored in *loc and the opcode to backpatch
+ * into it is returned.
+ */
+static char * genCond( TreeNode * tree, int * loc)
+{ char * op;
+  if ((tree->nodekind == ExpK) && (tree->kind.exp == OpK))
+  { switch (tree->attr.op) {
+      case LT : op = "JGE"; break;
+      case LE : op = "JGT"; break;
+      case GT : op = "JLE"; break;
+      case GE : op = "JLT"; break;
+      case EQ : op = "JNE"; break;
+      case NE : op = "JEQ"; break;
+      default : op = NULL; break;
+    }
+  }
+  else op = NULL;
+  if (op != NULL)
+  { if (TraceCode) emitComment("-> cond") ;
+    cGen(tree->child[0]);
+    emitRM("ST",ac,tmpOffset--,fp,"cond: push left");
+    cGen(tree->child[1]);
+    emitRM("LD",ac1,++tmpOffset,fp,"cond: load left");
+    emitRO("SUB",ac,ac1,ac,"cond: compare");
+    if (TraceCode) emitComment("<- cond") ;
+  }
+  else
+  { cGen(tree);
+    op = "JEQ";
+  }
+  *loc = emitSkip(1);
+  return op;
+} /* genCond */
 
 /* Procedure genStmt generates code at a statement node */
 static void genStmt( TreeNode * tree)
 { TreeNode * p1, * p2, * p3;
   int savedLoc1,savedLoc2,currentLoc;
-  int loc;
+  int savedOffset;
+  char * op;
+  BucketList l;
   switch (tree->kind.stmt) {
 
+      case VarDeclK :
+         genDecl(tree);
+         break; /* VarDeclK */
+
+      case FuncDeclK :
+         if (TraceCode) emitComment("-> function") ;
+         l = st_lookup(currentScope,tree->attr.name);
+         l->memloc = emitSkip(0);
+         emitFunction(tree->attr.name);
+         currentScope = findScope(tree,currentScope);
+         tmpOffset = initFO;
+         for (p1 = tree->child[0]; p1 != NULL; p1 = p1->sibling)
+           if (p1->kind.stmt == ParamK) genDecl(p1);
+         emitRM("ST",ac,retFO,fp,"function: store return address");
+         currentFunc = tree;
+         funcScope = currentScope;
+         bodyLoc = emitSkip(0);
+         /* the body shares the function scope */
+         p2 = tree->child[1];
+         for (p1 = p2->child[0]; p1 != NULL; p1 = p1->sibling)
+           genDecl(p1);
+         cGen(p2->child[1]);
+         genReturn();
+         currentScope = currentScope->parent;
+         if (TraceCode) emitComment("<- function") ;
+         break; /* FuncDeclK */
+
+      case CompoundK :
+         if (TraceCode) emitComment("-> compound") ;
+         currentScope = findScope(tree,currentScope);
+         savedOffset = tmpOffset;
+         cGen(tree->child[0]);
+         cGen(tree->child[1]);
+         tmpOffset = savedOffset;
+         currentScope = currentScope->parent;
+         if (TraceCode) emitComment("<- compound") ;
+         break; /* CompoundK */
+
       case IfK :
+      case IfElseK :
          if (TraceCode) emitComment("-> if") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
          p3 = tree->child[2] ;
          /* generate code for test expression */
-         cGen(p1);
-         savedLoc1 = emitSkip(1) ;
+         op = genCond(p1,&savedLoc1);
          emitComment("if: jump to else belongs here");
          /* recurse on then part */
          cGen(p2);
-         savedLoc2 = emitSkip(1) ;
-         emitComment("if: jump to end belongs here");
+         if (p3 != NULL)
+         { savedLoc2 = emitSkip(1) ;
+           emitComment("if: jump to end belongs here");
+         }
          currentLoc = emitSkip(0) ;
          emitBackup(savedLoc1) ;
-         emitRM_Abs("JEQ",ac,currentLoc,"if: jmp to else");
-         emitRestore() ;
-         /* recurse on else part */
-         cGen(p3);
-         currentLoc = emitSkip(0) ;
-         emitBackup(savedLoc2) ;
-         emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
+         emitRM_Abs(op,ac,currentLoc,"if: jmp to else");
          emitRestore() ;
+         if (p3 != NULL)
+         { /* recurse on else part */
+           cGen(p3);
+           currentLoc = emitSkip(0) ;
+           emitBackup(savedLoc2) ;
+           emitRM_Abs("LDA",pc,currentLoc,"jmp to end") ;
+           emitRestore() ;
+         }
          if (TraceCode)  emitComment("<- if") ;
          break; /* if_k */
 
-      case RepeatK:
-         if (TraceCode) emitComment("-> repeat") ;
+      case WhileK:
+         if (TraceCode) emitComment("-> while") ;
          p1 = tree->child[0] ;
          p2 = tree->child[1] ;
+         genIndPtrs(tree);
          savedLoc1 = emitSkip(0);
-         emitComment("repeat: jump after body comes back here");
-         /* generate code for body */
-         cGen(p1);
+         emitComment("while: jump after body comes back here");
          /* generate code for test */
+         op = genCond(p1,&savedLoc2);
+         emitComment("while: jump to end belongs here");
+         /* generate code for body */
          cGen(p2);
-         emitRM_Abs("JEQ",ac,savedLoc1,"repeat: jmp back to body");
-         if (TraceCode)  emitComment("<- repeat") ;
-         break; /* repeat */
+         emitRM_Abs("LDA",pc,savedLoc1,"while: jmp back to test");
+         currentLoc = emitSkip(0) ;
+         emitBackup(savedLoc2) ;
+         emitRM_Abs(op,ac,currentLoc,"while: jmp to end");
+         emitRestore() ;
+         nindPtrs = 0;
+         if (TraceCode)  emitComment("<- while") ;
+         break; /* while */
+
+      case ReturnK:
+         if (TraceCode) emitComment("-> return") ;
+         if (isTailCall(tree->child[0]))
+           genTailCall(tree->child[0]);
+         else
+         { cGen(tree->child[0]);
+           genReturn();
+         }
+         if (TraceCode)  emitComment("<- return") ;
+         break; /* return */
 
-      case AssignK:
-         if (TraceCode) emitComment("-> assign") ;
-         /* generate code for rhs */
-         cGen(tree->child[0]);
-         /* now store value */
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"assign: store value");
-         if (TraceCode)  emitComment("<- assign") ;
-         break; /* assign_k */
-
-      case ReadK:
-         emitRO("IN",ac,0,0,"read integer value");
-         loc = st_lookup(tree->attr.name);
-         emitRM("ST",ac,loc,gp,"read: store value");
-         break;
-      case WriteK:
-         /* generate code for expression to write */
-         cGen(tree->child[0]);
-         /* now output it */
-         emitRO("OUT",ac,0,0,"write ac");
-         break;
       default:
          break;
     }
@@ -96,8 +569,9 @@ static void genStmt( TreeNode * tree)
 
 /* Procedure genExp generates code at an expression node */
 static void genExp( TreeNode * tree)
-{ int loc;
+{ int savedOffset, reg;
   TreeNode * p1, * p2;
+  BucketList l;
   switch (tree->kind.exp) {
 
     case ConstK :
@@ -106,26 +580,84 @@ static void genExp( TreeNode * tree)
       emitRM("LDC",ac,tree->attr.val,0,"load const");
       if (TraceCode)  emitComment("<- Const") ;
       break; /* ConstK */
-    
-    case IdK :
-      if (TraceCode) emitComment("-> Id") ;
-      loc = st_lookup(tree->attr.name);
-      emitRM("LD",ac,loc,gp,"load id value");
-      if (TraceCode)  emitComment("<- Id") ;
-      break; /* IdK */
+
+    case VarAccessK :
+      if (TraceCode) emitComment("-> Var") ;
+      l = st_lookup(currentScope,tree->attr.name);
+      if ((tree->child[0] != NULL) && ((reg = findIndPtr(tree,currentScope)) >= 0))
+        emitRM("LD",ac,0,reg,"load array element at induction pointer");
+      else if (tree->child[0] != NULL)
+      { genElemAddr(tree);
+        emitRM("LD",ac,0,ac,"load array element");
+      }
+      else if (l->type == IntegerArr)
+        genArrayBase(l,ac);
+      else
+        emitRM("LD",ac,l->memloc,baseReg(l),"load id value");
+      if (TraceCode)  emitComment("<- Var") ;
+      break; /* VarAccessK */
+
+    case AssignK :
+      if (TraceCode) emitComment("-> assign") ;
+      p1 = tree->child[0];
+      p2 = tree->child[1];
+      l = st_lookup(currentScope,p1->attr.name);
+      if ((p1->child[0] != NULL) && ((reg = findIndPtr(p1,currentScope)) >= 0))
+      { cGen(p2);
+        emitRM("ST",ac,0,reg,"assign: store element at induction pointer");
+      }
+      else if (p1->child[0] != NULL)
+      { genElemAddr(p1);
+        emitRM("ST",ac,tmpOffset--,fp,"assign: push address");
+        cGen(p2);
+        emitRM("LD",ac1,++tmpOffset,fp,"assign: load address");
+        emitRM("ST",ac,0,ac1,"assign: store element");
+      }
+      else
+      { cGen(p2);
+        emitRM("ST",ac,l->memloc,baseReg(l),"assign: store value");
+      }
+      if (TraceCode)  emitComment("<- assign") ;
+      break; /* AssignK */
+
+    case CallK :
+      if (TraceCode) emitComment("-> call") ;
+      if (strcmp(tree->attr.name,"input") == 0)
+        emitRO("IN",ac,0,0,"read integer value");
+      else if (strcmp(tree->attr.name,"output") == 0)
+      { cGen(tree->child[0]);
+        emitRO("OUT",ac,0,0,"write ac");
+      }
+      else
+      { l = st_lookup(currentScope,tree->attr.name);
+        savedOffset = tmpOffset;
+        tmpOffset += initFO;
+        for (p1 = tree->child[0]; p1 != NULL; p1 = p1->sibling)
+        { genExp(p1);
+          emitRM("ST",ac,tmpOffset--,fp,"call: push argument");
+        }
+        emitRM("ST",fp,savedOffset+ofpFO,fp,"call: store control link");
+        emitRM("LDA",fp,savedOffset,fp,"call: push frame");
+        emitRM("LDA",ac,1,pc,"call: save return address");
+        emitRM_Abs("LDA",pc,l->memloc,"call: jump to function");
+        tmpOffset = savedOffset;
+      }
+      if (TraceCode)  emitComment("<- call") ;
+      break; /* CallK */
 
     case OpK :
+         if (genConstOp(tree)) break;
          if (TraceCode) emitComment("-> Op") ;
          p1 = tree->child[0];
          p2 = tree->child[1];
          /* gen code for ac = left arg */
          cGen(p1);
          /* gen code to push left operand */
-         emitRM("ST",ac,tmpOffset--,mp,"op: push left");
+         emitRM("ST",ac,tmpOffset--,fp,"op: push left");
          /* gen code for ac = right operand */
          cGen(p2);
          /* now load left operand */
-         emitRM("LD",ac1,++tmpOffset,mp,"op: load left");
+         emitRM("LD",ac1,++tmpOffset,fp,"op: load left");
          switch (tree->attr.op) {
             case PLUS :
                emitRO("ADD",ac,ac1,ac,"op +");
@@ -140,15 +672,20 @@ static void genExp( TreeNode * tree)
                emitRO("DIV",ac,ac1,ac,"op /");
                break;
             case LT :
-               emitRO("SUB",ac,ac1,ac,"op <") ;
-               emitRM("JLT",ac,2,pc,"br if true") ;
-               emitRM("LDC",ac,0,ac,"false case") ;
-               emitRM("LDA",pc,1,pc,"unconditional jmp") ;
-               emitRM("LDC",ac,1,ac,"true case") ;
-               break;
+            case LE :
+            case GT :
+            case GE :
             case EQ :
-               emitRO("SUB",ac,ac1,ac,"op ==") ;
-               emitRM("JEQ",ac,2,pc,"br if true");
+            case NE :
+               emitRO("SUB",ac,ac1,ac,"op relational") ;
+               switch (tree->attr.op) {
+                  case LT : emitRM("JLT",ac,2,pc,"br if true") ; break;
+                  case LE : emitRM("JLE",ac,2,pc,"br if true") ; break;
+                  case GT : emitRM("JGT",ac,2,pc,"br if true") ; break;
+                  case GE : emitRM("JGE",ac,2,pc,"br if true") ; break;
+                  case EQ : emitRM("JEQ",ac,2,pc,"br if true") ; break;
+                  default : emitRM("JNE",ac,2,pc,"br if true") ; break;
+               }
                emitRM("LDC",ac,0,ac,"false case") ;
                emitRM("LDA",pc,1,pc,"unconditional jmp") ;
                emitRM("LDC",ac,1,ac,"true case") ;
@@ -170,7 +707,8 @@ static void genExp( TreeNode * tree)
  */
 static void cGen( TreeNode * tree)
 { if (tree != NULL)
-  { switch (tree->nodekind) {
+  { int savedLine = emitLine(sourceLine(tree));
+    switch (tree->nodekind) {
       case StmtK:
         genStmt(tree);
         break;
@@ -180,6 +718,8 @@ static void cGen( TreeNode * tree)
       default:
         break;
     }
+    genIndSteps(tree);
+    emitLine(savedLine);
     cGen(tree->sibling);
   }
 }
@@ -194,19 +734,36 @@ static void cGen( TreeNode * tree)
  * file name as a comment in the code file
  */
 void codeGen(TreeNode * syntaxTree, char * codefile)
-{  char * s = malloc(strlen(codefile)+7);
+{  extern ScopeList globalScope;
+   BucketList l;
+   int mainLoc;
+   char * s = malloc(strlen(codefile)+7);
    strcpy(s,"File: ");
    strcat(s,codefile);
    emitComment("C-MINUS Compilation to TM Code");
    emitComment(s);
    /* generate standard prelude */
+   emitFunction("_start");
    emitComment("Standard prelude:");
    emitRM("LD",mp,0,ac,"load maxaddress from location 0");
    emitRM("ST",ac,0,ac,"clear location 0");
+   emitRM("LDA",fp,0,mp,"set up frame for main");
    emitComment("End of standard prelude.");
+   emitRM("ST",fp,ofpFO,fp,"store control link");
+   emitRM("LDA",ac,1,pc,"save return address");
+   mainLoc = emitSkip(1);
+   emitComment("jump to main belongs here");
+   emitRO("HALT",0,0,0,"");
    /* generate code for C-MINUS program */
+   currentScope = globalScope;
    cGen(syntaxTree);
    /* finish */
+   l = st_lookup(globalScope,"main");
+   if ((l != NULL) && (l->type == Function))
+   { emitBackup(mainLoc);
+     emitRM_Abs("LDA",pc,l->memloc,"jump to main");
+     emitRestore();
+   }
    emitComment("End of execution.");
-   emitRO("HALT",0,0,0,"");
+   emitLineTable();
 }
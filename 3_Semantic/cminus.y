@@ -124,6 +124,7 @@ params : param_list
       | VOID
         {
           $$ = newStmtNode(VoidParamK);
+          $$->type = Void;
           $$->lineno = lineno;
         }
       ;
@@ -0,0 +1,78 @@
+/****************************************************/
+/* File: cmrt.c                                     */
+/* Runtime of C-MINUS programs compiled to x86-64   */
+/* assembly: input, output and the fault exits,     */
+/* with the messages and exit status of             */
+/* "tm --run". Link it with the assembled program:  */
+/*    cc prog.s cmrt.c -o prog                      */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/* the compiled program; C-MINUS names get the
+ * prefix cm_ so they cannot clash with the C
+ * library
+ */
+extern void cm_main ( void );
+
+/* finish ends the run with a fault as tm --run
+ * does: message on stderr, the result as status
+ */
+static void finish ( int res, char * msg )
+{ fflush(stdout);
+  fprintf(stderr, "%s\n", msg);
+  exit(res);
+} /* finish */
+
+/* cm_input reads a decimal integer after white
+ * space, as the batch input of tm.c
+ */
+int cm_input ( void )
+{ unsigned int v = 0;
+  int c, neg = 0;
+  do c = getchar_unlocked(); while ( (c != EOF) && isspace(c) );
+  if ( (c == '-') || (c == '+') )
+  { neg = (c == '-');
+    c = getchar_unlocked();
+  }
+  if ( (c == EOF) || ! isdigit(c) ) finish(5, "Input Error");
+  do
+  { v = v * 10 + (c - '0');
+    c = getchar_unlocked();
+  } while ( (c != EOF) && isdigit(c) );
+  if ( c != EOF ) ungetc(c, stdin);
+  return (int) (neg ? -v : v);
+} /* cm_input */
+
+void cm_output ( int val )
+{ char digits[12];
+  unsigned int v = (val < 0) ? - (unsigned int) val : (unsigned int) val;
+  int n = 0;
+  do
+  { digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while ( v != 0 );
+  if ( val < 0 ) putchar_unlocked('-');
+  while ( n > 0 ) putchar_unlocked(digits[--n]);
+  putchar_unlocked('\n');
+} /* cm_output */
+
+/* cm_divzero is reached on a division by 0 */
+void cm_divzero ( void )
+{ finish(4, "Division by 0");
+} /* cm_divzero */
+
+/* cm_divoverflow is reached on a division of
+ * the least integer by -1
+ */
+void cm_divoverflow ( void )
+{ finish(9, "Division Overflow");
+} /* cm_divoverflow */
+
+int main ( void )
+{ cm_main();
+  fflush(stdout);
+  return 0;
+}
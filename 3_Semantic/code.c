@@ -7,6 +7,7 @@
 /****************************************************/
 
 #include "globals.h"
+#include "util.h"
 #include "code.h"
 
 /* TM location number for current instruction emission */
@@ -17,6 +18,39 @@ static int emitLoc = 0 ;
    emitBackup, and emitRestore */
 static int highEmitLoc = 0;
 
+/* source line and function the instructions
+   emitted next are attributed to */
+static int srcLine = 0 ;
+static int srcFunc = -1 ;
+
+/* line table: source line and function index
+   of every emitted location, with the names and
+   entry locations of the functions */
+static int * locLine = NULL ;
+static int * locFunc = NULL ;
+static int locTabSize = 0 ;
+static char ** funcName = NULL ;
+static int * funcEntry = NULL ;
+static int funcCount = 0 ;
+
+/* Procedure noteLoc records the current source
+ * position for location loc in the line table
+ */
+static void noteLoc( int loc )
+{ if (loc >= locTabSize)
+  { int i, size = (loc + 1) * 2;
+    locLine = (int *) realloc(locLine, size * sizeof(int));
+    locFunc = (int *) realloc(locFunc, size * sizeof(int));
+    for (i = locTabSize; i < size; i++)
+    { locLine[i] = 0;
+      locFunc[i] = -1;
+    }
+    locTabSize = size;
+  }
+  locLine[loc] = srcLine;
+  locFunc[loc] = srcFunc;
+} /* noteLoc */
+
 /* Procedure emitComment prints a comment line 
  * with comment c in the code file
  */
@@ -32,7 +66,8 @@ void emitComment( char * c )
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRO( char *op, int r, int s, int t, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
+{ noteLoc(emitLoc);
+  fprintf(code,"%3d:  %5s  %d,%d,%d ",emitLoc++,op,r,s,t);
   if (TraceCode) fprintf(code,"\t%s",c) ;
   fprintf(code,"\n") ;
   if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
@@ -47,7 +82,8 @@ void emitRO( char *op, int r, int s, int t, char *c)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM( char * op, int r, int d, int s, char *c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
+{ noteLoc(emitLoc);
+  fprintf(code,"%3d:  %5s  %d,%d(%d) ",emitLoc++,op,r,d,s);
   if (TraceCode) fprintf(code,"\t%s",c) ;
   fprintf(code,"\n") ;
   if (highEmitLoc < emitLoc)  highEmitLoc = emitLoc ;
@@ -88,10 +124,57 @@ void emitRestore(void)
  * c = a comment to be printed if TraceCode is TRUE
  */
 void emitRM_Abs( char *op, int r, int a, char * c)
-{ fprintf(code,"%3d:  %5s  %d,%d(%d) ",
+{ noteLoc(emitLoc);
+  fprintf(code,"%3d:  %5s  %d,%d(%d) ",
                emitLoc,op,r,a-(emitLoc+1),pc);
   ++emitLoc ;
   if (TraceCode) fprintf(code,"\t%s",c) ;
   fprintf(code,"\n") ;
   if (highEmitLoc < emitLoc) highEmitLoc = emitLoc ;
 } /* emitRM_Abs */
+
+/* Function emitLine sets the source line the
+ * instructions emitted next belong to and
+ * returns the previous one, for restoring
+ */
+int emitLine( int lineno )
+{ int old = srcLine;
+  srcLine = lineno;
+  return old;
+} /* emitLine */
+
+/* Procedure emitFunction starts function name:
+ * its entry is the current location, and the
+ * instructions emitted next belong to it
+ */
+void emitFunction( char * name )
+{ funcName = (char **) realloc(funcName, (funcCount+1) * sizeof(char *));
+  funcEntry = (int *) realloc(funcEntry, (funcCount+1) * sizeof(int));
+  funcName[funcCount] = copyString(name);
+  funcEntry[funcCount] = emitLoc;
+  srcFunc = funcCount++;
+} /* emitFunction */
+
+/* Procedure emitLineTable writes the line table
+ * as comment records that TM reads for profiling:
+ *   *@ func <entry> <name>
+ *   *@ line <from> <to> <lineno>
+ * one line record per run of locations with the
+ * same source line
+ */
+void emitLineTable(void)
+{ int f, loc, from;
+  for (f = 0; f < funcCount; f++)
+    fprintf(code,"*@ func %d %s\n",funcEntry[f],funcName[f]);
+  loc = 0;
+  while (loc < highEmitLoc && loc < locTabSize)
+  { from = loc;
+    while (loc+1 < highEmitLoc && loc+1 < locTabSize &&
+           locLine[loc+1] == locLine[from] &&
+           locFunc[loc+1] == locFunc[from])
+      loc++;
+    if (locLine[from] > 0)
+      fprintf(code,"*@ line %d %d %d\n",from,loc,locLine[from]);
+    loc++;
+  }
+} /* emitLineTable */
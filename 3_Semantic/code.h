@@ -17,6 +17,11 @@
  */
 #define  mp 6
 
+/* fp = "frame pointer" points
+ * to the current activation record
+ */
+#define fp 4
+
 /* gp = "global pointer" points
  * to bottom of memory for (global)
  * variable storage
@@ -29,6 +34,12 @@
 /* 2nd accumulator */
 #define  ac1 1
 
+/* registers holding element addresses in
+ * innermost loops: pr up to pr+NPTRREGS-1
+ */
+#define  pr 2
+#define  NPTRREGS 2
+
 /* code emitting utilities */
 
 /* Procedure emitComment prints a comment line 
@@ -83,4 +94,21 @@ void emitRestore(void);
  */
 void emitRM_Abs( char *op, int r, int a, char * c);
 
+/* Function emitLine sets the source line the
+ * instructions emitted next belong to and
+ * returns the previous one, for restoring
+ */
+int emitLine( int lineno );
+
+/* Procedure emitFunction starts function name:
+ * its entry is the current location, and the
+ * instructions emitted next belong to it
+ */
+void emitFunction( char * name );
+
+/* Procedure emitLineTable writes the line table
+ * as comment records that TM reads for profiling
+ */
+void emitLineTable(void);
+
 #endif
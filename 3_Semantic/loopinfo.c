@@ -0,0 +1,110 @@
+/****************************************************/
+/* File: loopinfo.c                                 */
+/* Loop analysis for the C-MINUS compiler: what a   */
+/* while loop assigns and which of its expressions  */
+/* do not change in it                              */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include "loopinfo.h"
+
+/* Procedure scanList records in loop the
+ * variables assigned in tree t and its siblings,
+ * in scope, their calls and their loops
+ */
+static void scanList( TreeNode * t, ScopeList scope, LoopInfo * loop)
+{ ScopeList s;
+  int i;
+  for (; t != NULL; t = t->sibling)
+  { s = scope;
+    if ((t->nodekind == StmtK) && (t->kind.stmt == CompoundK))
+      s = findScope(t,scope);
+    else if ((t->nodekind == StmtK) && (t->kind.stmt == WhileK))
+      loop->loops = TRUE;
+    else if ((t->nodekind == ExpK) && (t->kind.exp == AssignK))
+    { if (loop->nassigned == loop->maxAssigned)
+      { loop->maxAssigned = 2 * loop->maxAssigned + 16;
+        loop->assigned = (BucketList *)
+          realloc(loop->assigned,loop->maxAssigned * sizeof(BucketList));
+      }
+      loop->assigned[loop->nassigned++] = st_lookup(scope,t->child[0]->attr.name);
+    }
+    else if ((t->nodekind == ExpK) && (t->kind.exp == CallK) &&
+             (strcmp(t->attr.name,"input") != 0) && (strcmp(t->attr.name,"output") != 0))
+      loop->calls = TRUE;
+    for (i = 0; i < MAXCHILDREN; i++)
+      scanList(t->child[i],s,loop);
+  }
+} /* scanList */
+
+/* Procedure scanLoop records in loop what the
+ * while statement tree, in scope, assigns, calls
+ * and contains
+ */
+void scanLoop( TreeNode * tree, ScopeList scope, LoopInfo * loop)
+{ loop->scope = scope;
+  loop->nassigned = 0;
+  loop->calls = FALSE;
+  loop->loops = FALSE;
+  scanList(tree->child[0],scope,loop);
+  scanList(tree->child[1],scope,loop);
+}
+
+/* Function timesAssigned returns how many
+ * assignments to l the loop has
+ */
+int timesAssigned( LoopInfo * loop, BucketList l)
+{ int i, n = 0;
+  for (i = 0; i < loop->nassigned; i++)
+    if (loop->assigned[i] == l) n++;
+  return n;
+}
+
+/* Function loopVar returns the entry of the
+ * scalar t, in scope, if it is declared around
+ * the loop, or NULL
+ */
+BucketList loopVar( TreeNode * t, ScopeList scope, LoopInfo * loop)
+{ BucketList l;
+  if ((t->nodekind != ExpK) || (t->kind.exp != VarAccessK) ||
+      (t->child[0] != NULL))
+    return NULL;
+  l = st_lookup(scope,t->attr.name);
+  if ((l == NULL) || (l->type != Integer) ||
+      (st_lookup(loop->scope,t->attr.name) != l))
+    return NULL;
+  return l;
+}
+
+/* Function isLoopInvariant returns TRUE if the
+ * expression t, in scope, has the same value on
+ * every iteration of the loop and computing it
+ * cannot fault: operations on constants and on
+ * scalars declared around the loop that are not
+ * assigned in it, nor globals if it has calls.
+ * Variables without an entry hold expressions
+ * moved already.
+ */
+int isLoopInvariant( TreeNode * t, ScopeList scope, LoopInfo * loop)
+{ BucketList l;
+  if (t->nodekind != ExpK) return FALSE;
+  switch (t->kind.exp) {
+    case ConstK :
+      return TRUE;
+    case VarAccessK :
+      if ((t->child[0] == NULL) && (st_lookup(scope,t->attr.name) == NULL))
+        return TRUE;
+      return ((l = loopVar(t,scope,loop)) != NULL) &&
+             (timesAssigned(loop,l) == 0) &&
+             ! (loop->calls && (l->scope->parent == NULL));
+    case OpK :
+      if ((t->attr.op == OVER) && ! isSafeDivisor(t->child[1]))
+        return FALSE;
+      return isLoopInvariant(t->child[0],scope,loop) &&
+             isLoopInvariant(t->child[1],scope,loop);
+    default :
+      return FALSE;
+  }
+}
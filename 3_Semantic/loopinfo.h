@@ -0,0 +1,48 @@
+/****************************************************/
+/* File: loopinfo.h                                 */
+/* Loop analysis interface for the C-MINUS compiler */
+/* shared by the optimizer and the code generator   */
+/****************************************************/
+
+#ifndef _LOOPINFO_H_
+#define _LOOPINFO_H_
+
+/* The record of one while loop, filled by
+ * scanLoop. A record may be scanned again for
+ * another loop; it keeps its buffer.
+ */
+typedef struct
+   { ScopeList scope;      /* scope around the loop */
+     BucketList * assigned;/* variables assigned, once per assignment */
+     int nassigned;
+     int maxAssigned;
+     int calls;            /* TRUE if it calls a function but input and output */
+     int loops;            /* TRUE if it has inner loops */
+   } LoopInfo;
+
+/* Procedure scanLoop records in loop what the
+ * while statement tree, in scope, assigns, calls
+ * and contains
+ */
+void scanLoop(TreeNode *, ScopeList, LoopInfo *);
+
+/* Function timesAssigned returns how many
+ * assignments to a variable the loop has
+ */
+int timesAssigned(LoopInfo *, BucketList);
+
+/* Function loopVar returns the entry of the
+ * scalar variable access tree, in scope, if it is
+ * declared around the loop, or NULL
+ */
+BucketList loopVar(TreeNode *, ScopeList, LoopInfo *);
+
+/* Function isLoopInvariant returns TRUE if the
+ * expression tree, in scope, has the same value
+ * on every iteration of the loop and computing
+ * it cannot fault. Variables without an entry
+ * hold invariants moved before the loop already.
+ */
+int isLoopInvariant(TreeNode *, ScopeList, LoopInfo *);
+
+#endif
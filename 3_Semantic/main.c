@@ -15,7 +15,7 @@
 /* set NO_CODE to TRUE to get a compiler that does not
  * generate code
  */
-#define NO_CODE TRUE
+#define NO_CODE FALSE
 
 #include "util.h"
 #if NO_PARSE
@@ -24,8 +24,12 @@
 #include "parse.h"
 #if !NO_ANALYZE
 #include "analyze.h"
+#include "optimize.h"
+#include "callgraph.h"
 #if !NO_CODE
 #include "cgen.h"
+#include "x86gen.h"
+#include "ccgen.h"
 #endif
 #endif
 #endif
@@ -48,8 +52,44 @@ int Error = FALSE;
 main( int argc, char * argv[] )
 { TreeNode * syntaxTree;
   char pgm[120]; /* source code file name */
-  if (argc != 2)
-    { fprintf(stderr,"usage: %s <filename>\n",argv[0]);
+  int x86flag = FALSE; /* x86-64 assembly instead of TM code */
+  int cflag = FALSE;   /* C instead of TM code */
+  int optflag = TRUE;  /* run the optimization passes */
+  int inlineSize = 40;    /* largest function body inlined, in nodes */
+  int inlineGrowth = 400; /* nodes inlining may add to a function */
+  char * graphFormat = NULL; /* "dot" or "json" to dump the call graph */
+  while ((argc > 2) && (strncmp(argv[1],"--",2) == 0))
+  { if (strcmp(argv[1],"--x86") == 0) x86flag = TRUE;
+    else if (strcmp(argv[1],"--c") == 0) cflag = TRUE;
+    else if (strcmp(argv[1],"--no-opt") == 0) optflag = FALSE;
+    else if (strcmp(argv[1],"--trace-analyze") == 0) TraceAnalyze = TRUE;
+    else if ((strcmp(argv[1],"--inline-size") == 0) && (argc > 3))
+    { inlineSize = atoi(argv[2]);
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+    }
+    else if ((strcmp(argv[1],"--dump-callgraph") == 0) && (argc > 3) &&
+             ((strcmp(argv[2],"dot") == 0) || (strcmp(argv[2],"json") == 0)))
+    { graphFormat = argv[2];
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+    }
+    else if ((strcmp(argv[1],"--inline-growth") == 0) && (argc > 3))
+    { inlineGrowth = atoi(argv[2]);
+      argv[1] = argv[0];
+      argv++;
+      argc--;
+    }
+    else break;
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
+  if ((argc != 2) || (x86flag && cflag))
+    { fprintf(stderr,"usage: %s [--x86 | --c] [--no-opt] [--inline-size n] [--inline-growth n]\n"
+                     "       [--dump-callgraph dot|json] [--trace-analyze] <filename>\n",argv[0]);
       exit(1);
     }
   strcpy(pgm,argv[1]) ;
@@ -71,6 +111,30 @@ main( int argc, char * argv[] )
     printTree(syntaxTree);
   }
 #if !NO_ANALYZE
+  if ((! Error) && (graphFormat != NULL))
+  { char * graphfile;
+    FILE * graph;
+    CallGraph g;
+    int fnlen = strcspn(pgm,".");
+    graphfile = (char *) calloc(fnlen+6, sizeof(char));
+    strncpy(graphfile,pgm,fnlen);
+    strcat(graphfile,".");
+    strcat(graphfile,graphFormat);
+    graph = fopen(graphfile,"w");
+    if (graph == NULL)
+    { printf("Unable to open %s\n",graphfile);
+      exit(1);
+    }
+    g = buildCallGraph(syntaxTree);
+    printCallGraph(g,graph,strcmp(graphFormat,"json") == 0);
+    freeCallGraph(g);
+    fclose(graph);
+    fprintf(listing,"Call graph written to %s\n",graphfile);
+  }
+  if ((! Error) && optflag)
+  { if (TraceAnalyze) fprintf(listing,"\nFinding Dead Functions...\n");
+    skipDeadFunctions(syntaxTree);
+  }
   if (! Error)
   { if (TraceAnalyze) fprintf(listing,"\nBuilding Symbol Table...\n");
     buildSymtab(syntaxTree);
@@ -78,19 +142,42 @@ main( int argc, char * argv[] )
     typeCheck(syntaxTree);
     if (TraceAnalyze) fprintf(listing,"\nType Checking Finished\n");
   }
+  if ((! Error) && optflag)
+  { syntaxTree = removeDeadFunctions(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nInlining Calls...\n");
+    if (inlineCalls(syntaxTree,inlineSize,inlineGrowth) > 0)
+    { if (TraceAnalyze) fprintf(listing,"\nRebuilding Symbol Table...\n");
+      buildSymtab(syntaxTree);
+    }
+    if (TraceAnalyze) fprintf(listing,"\nFolding Constants...\n");
+    foldConstants(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nRemoving Dead Code...\n");
+    removeDeadCode(syntaxTree);
+    if (TraceAnalyze) fprintf(listing,"\nMoving Loop Invariants...\n");
+    if (moveInvariants(syntaxTree) > 0)
+    { if (TraceAnalyze) fprintf(listing,"\nRebuilding Symbol Table...\n");
+      buildSymtab(syntaxTree);
+    }
+  }
 #if !NO_CODE
   if (! Error)
   { char * codefile;
     int fnlen = strcspn(pgm,".");
     codefile = (char *) calloc(fnlen+4, sizeof(char));
     strncpy(codefile,pgm,fnlen);
-    strcat(codefile,".tm");
+    strcat(codefile,x86flag ? ".s" : cflag ? ".c" : ".tm");
+    if (strcmp(codefile,pgm) == 0)
+    { printf("Code file %s would replace the source\n",codefile);
+      exit(1);
+    }
     code = fopen(codefile,"w");
     if (code == NULL)
     { printf("Unable to open %s\n",codefile);
       exit(1);
     }
-    codeGen(syntaxTree,codefile);
+    if (x86flag) x86Gen(syntaxTree,codefile,pgm);
+    else if (cflag) ccGen(syntaxTree,codefile,pgm);
+    else codeGen(syntaxTree,codefile);
     fclose(code);
   }
 #endif
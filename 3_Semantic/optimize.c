@@ -0,0 +1,988 @@
+/****************************************************/
+/* File: optimize.c                                 */
+/* Optimization passes on the checked syntax tree   */
+/* of the C-MINUS compiler. They rewrite the tree   */
+/* in place and keep the behavior of the program    */
+/* as the TM code shows it.                         */
+/****************************************************/
+
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include "callgraph.h"
+#include "loopinfo.h"
+#include "optimize.h"
+
+/* nodes removed from the tree by the pass running */
+static int removed = 0;
+
+/* Function countNodes returns the number of
+ * nodes of tree and its children
+ */
+static int countNodes( TreeNode * t)
+{ int i, n = 1;
+  if (t == NULL) return 0;
+  for (i = 0; i < MAXCHILDREN; i++)
+  { TreeNode * p;
+    for (p = t->child[i]; p != NULL; p = p->sibling)
+      n += countNodes(p);
+  }
+  return n;
+} /* countNodes */
+
+/* Function isConst returns TRUE if t is the
+ * constant val
+ */
+static int isConst( TreeNode * t, int val)
+{ return (t->nodekind == ExpK) && (t->kind.exp == ConstK) &&
+         (t->attr.val == val);
+} /* isConst */
+
+/* Function isPure returns TRUE if evaluating t
+ * can neither change the state, read input nor
+ * fault by a division, so it may be dropped
+ */
+static int isPure( TreeNode * t)
+{ int i;
+  if (t == NULL) return TRUE;
+  if (t->nodekind != ExpK) return FALSE;
+  switch (t->kind.exp) {
+    case AssignK :
+    case CallK :
+      return FALSE;
+    case OpK :
+      if ((t->attr.op == OVER) && ! isSafeDivisor(t->child[1]))
+        return FALSE;
+      break;
+    default :
+      break;
+  }
+  for (i = 0; i < MAXCHILDREN; i++)
+    if (! isPure(t->child[i])) return FALSE;
+  return TRUE;
+} /* isPure */
+
+/* Procedure replaceBy replaces t by its
+ * descendant by, keeping the sibling of t
+ */
+static void replaceBy( TreeNode * t, TreeNode * by)
+{ TreeNode * sibling = t->sibling;
+  removed += countNodes(t) - countNodes(by);
+  *t = *by;
+  t->sibling = sibling;
+} /* replaceBy */
+
+/* Procedure makeConst replaces t by the
+ * constant val
+ */
+static void makeConst( TreeNode * t, int val)
+{ int i;
+  removed += countNodes(t) - 1;
+  t->kind.exp = ConstK;
+  t->attr.val = val;
+  t->type = Integer;
+  for (i = 0; i < MAXCHILDREN; i++) t->child[i] = NULL;
+} /* makeConst */
+
+/* Procedure foldOp folds the operation t whose
+ * operands are folded already. Arithmetic wraps
+ * around as TM's; a relational operation is
+ * folded only when TM's subtraction of its
+ * operands does not overflow, and a division
+ * only when TM can carry it out.
+ */
+static void foldOp( TreeNode * t)
+{ TreeNode * l = t->child[0], * r = t->child[1];
+  unsigned int a, b;
+  long long d;
+  int v;
+  if ((t->attr.op == OVER) && isConst(r,0))
+  { fprintf(listing,"Semantic Warning: division by zero at line %d\n",t->lineno);
+    return;
+  }
+  if ((l->kind.exp == ConstK) && (r->kind.exp == ConstK))
+  { a = (unsigned int) l->attr.val;
+    b = (unsigned int) r->attr.val;
+    d = (long long) l->attr.val - r->attr.val;
+    switch (t->attr.op) {
+      case PLUS : v = (int) (a + b); break;
+      case MINUS : v = (int) (a - b); break;
+      case TIMES : v = (int) (a * b); break;
+      case OVER :
+        if ((r->attr.val == -1) && (l->attr.val == (int) (1u << 31))) return;
+        v = l->attr.val / r->attr.val;
+        break;
+      default :
+        if (d != (int) d) return;
+        switch (t->attr.op) {
+          case LT : v = d < 0; break;
+          case LE : v = d <= 0; break;
+          case GT : v = d > 0; break;
+          case GE : v = d >= 0; break;
+          case EQ : v = d == 0; break;
+          case NE : v = d != 0; break;
+          default : return;
+        }
+        break;
+    }
+    makeConst(t,v);
+    return;
+  }
+  switch (t->attr.op) {
+    case PLUS :
+      if (isConst(r,0)) replaceBy(t,l);
+      else if (isConst(l,0)) replaceBy(t,r);
+      break;
+    case MINUS :
+      if (isConst(r,0)) replaceBy(t,l);
+      else if (isPure(l) && sameExp(l,r)) makeConst(t,0);
+      break;
+    case TIMES :
+      if (isConst(r,1)) replaceBy(t,l);
+      else if (isConst(l,1)) replaceBy(t,r);
+      else if ((isConst(r,0) && isPure(l)) || (isConst(l,0) && isPure(r)))
+        makeConst(t,0);
+      break;
+    case OVER :
+      if (isConst(r,1)) replaceBy(t,l);
+      break;
+    default :
+      break;
+  }
+} /* foldOp */
+
+/* Procedure fold folds the expressions of tree
+ * in postorder
+ */
+static void fold( TreeNode * tree)
+{ int i;
+  for (; tree != NULL; tree = tree->sibling)
+  { for (i = 0; i < MAXCHILDREN; i++)
+      fold(tree->child[i]);
+    if ((tree->nodekind == ExpK) && (tree->kind.exp == OpK))
+      foldOp(tree);
+  }
+} /* fold */
+
+/* Procedure foldConstants replaces operations on
+ * constants by their value and simplifies
+ * algebraic identities
+ */
+void foldConstants(TreeNode * syntaxTree)
+{ removed = 0;
+  fold(syntaxTree);
+  if (TraceAnalyze)
+    fprintf(listing,"Constant folding removed %d nodes\n",removed);
+}
+
+static int listEnds( TreeNode * t);
+
+/* Function stmtEnds returns TRUE if control
+ * never goes on after statement t: it returns
+ * on every path, or loops forever (C-MINUS has
+ * no break)
+ */
+static int stmtEnds( TreeNode * t)
+{ if (t->nodekind != StmtK) return FALSE;
+  switch (t->kind.stmt) {
+    case ReturnK :
+      return TRUE;
+    case IfElseK :
+      return listEnds(t->child[1]) && listEnds(t->child[2]);
+    case CompoundK :
+      return listEnds(t->child[1]);
+    case WhileK :
+      return (t->child[0]->kind.exp == ConstK) && (t->child[0]->attr.val != 0);
+    default :
+      return FALSE;
+  }
+} /* stmtEnds */
+
+/* Function listEnds returns TRUE if control
+ * never goes on after the statement list t
+ */
+static int listEnds( TreeNode * t)
+{ for (; t != NULL; t = t->sibling)
+    if (stmtEnds(t)) return TRUE;
+  return FALSE;
+} /* listEnds */
+
+static void deadStmts( TreeNode ** list);
+
+/* Function keepStmt simplifies the statement at
+ * *p and returns FALSE if it is dead as a whole:
+ * a branch not taken, a loop never run or an
+ * expression without effect. A constant if is
+ * replaced by the branch taken, keeping the node
+ * its scope is found by.
+ */
+static int keepStmt( TreeNode ** p)
+{ TreeNode * t = *p, * taken;
+  if (t->nodekind == ExpK)
+  { if (! isPure(t)) return TRUE;
+    if (TraceAnalyze)
+      fprintf(listing,"  line %d: statement has no effect\n",t->lineno);
+    removed += countNodes(t);
+    return FALSE;
+  }
+  switch (t->kind.stmt) {
+    case CompoundK :
+      deadStmts(&t->child[1]);
+      break;
+    case IfK :
+    case IfElseK :
+      if (t->child[0]->kind.exp == ConstK)
+      { taken = (t->child[0]->attr.val != 0) ? t->child[1] : t->child[2];
+        if (TraceAnalyze)
+          fprintf(listing,"  line %d: if condition is always %s\n",
+                  t->child[0]->lineno,(t->child[0]->attr.val != 0) ? "true" : "false");
+        if (taken == NULL)
+        { removed += countNodes(t);
+          return FALSE;
+        }
+        removed += countNodes(t) - countNodes(taken);
+        taken->sibling = t->sibling;
+        *p = taken;
+        return keepStmt(p);
+      }
+      deadStmts(&t->child[1]);
+      deadStmts(&t->child[2]);
+      if ((t->child[1] == NULL) && (t->child[2] == NULL) && isPure(t->child[0]))
+      { if (TraceAnalyze)
+          fprintf(listing,"  line %d: if statement has no effect\n",t->child[0]->lineno);
+        removed += countNodes(t);
+        return FALSE;
+      }
+      break;
+    case WhileK :
+      if (isConst(t->child[0],0))
+      { if (TraceAnalyze)
+          fprintf(listing,"  line %d: while loop never runs\n",t->child[0]->lineno);
+        removed += countNodes(t);
+        return FALSE;
+      }
+      deadStmts(&t->child[1]);
+      break;
+    default :
+      break;
+  }
+  return TRUE;
+} /* keepStmt */
+
+/* Procedure deadStmts removes the dead
+ * statements of the statement list at *list
+ * and those that cannot be reached
+ */
+static void deadStmts( TreeNode ** list)
+{ TreeNode * t, * p;
+  while (*list != NULL)
+  { if (! keepStmt(list))
+    { *list = (*list)->sibling;
+      continue;
+    }
+    t = *list;
+    if ((t->sibling != NULL) && stmtEnds(t))
+    { if (TraceAnalyze)
+        fprintf(listing,"  line %d: unreachable code\n",
+                t->sibling->lineno);
+      for (p = t->sibling; p != NULL; p = p->sibling)
+        removed += countNodes(p);
+      t->sibling = NULL;
+    }
+    list = &t->sibling;
+  }
+} /* deadStmts */
+
+/* Procedure removeDeadCode removes unreachable
+ * statements and collapses constant branches
+ */
+void removeDeadCode(TreeNode * syntaxTree)
+{ TreeNode * t;
+  removed = 0;
+  for (t = syntaxTree; t != NULL; t = t->sibling)
+    if ((t->nodekind == StmtK) && (t->kind.stmt == FuncDeclK))
+      deadStmts(&t->child[1]->child[1]);
+  if (TraceAnalyze)
+    fprintf(listing,"Dead code elimination removed %d nodes\n",removed);
+}
+
+/* limits of the inliner, set by inlineCalls */
+static int sizeBudget, growthBudget;
+
+/* call graph of the program being inlined */
+static CallGraph graph;
+
+/* names declared in the function being inlined
+ * into, with TRUE for arrays
+ */
+static char ** callerNames = NULL;
+static int * callerArr = NULL;
+static int ncallerNames = 0, maxCallerNames = 0;
+
+/* renaming of the callee's names while a body
+ * is copied, innermost last
+ */
+static char ** oldNames = NULL, ** newNames = NULL;
+static int nrenamed = 0, maxRenamed = 0;
+
+/* calls expanded, and counter for fresh names */
+static int inlined = 0;
+static int freshNo = 0;
+
+/* Procedure addCallerName records a name
+ * declared in the function inlined into
+ */
+static void addCallerName( char * name, int isArr)
+{ if (ncallerNames == maxCallerNames)
+  { maxCallerNames = 2 * maxCallerNames + 16;
+    callerNames = (char **) realloc(callerNames,maxCallerNames * sizeof(char *));
+    callerArr = (int *) realloc(callerArr,maxCallerNames * sizeof(int));
+  }
+  callerNames[ncallerNames] = name;
+  callerArr[ncallerNames++] = isArr;
+} /* addCallerName */
+
+/* Procedure collectNames records the names
+ * declared in the tree t
+ */
+static void collectNames( TreeNode * t)
+{ int i;
+  for (; t != NULL; t = t->sibling)
+  { if ((t->nodekind == StmtK) &&
+        ((t->kind.stmt == ParamK) || (t->kind.stmt == VarDeclK)))
+      addCallerName(t->attr.name,t->type != Integer);
+    for (i = 0; i < MAXCHILDREN; i++)
+      collectNames(t->child[i]);
+  }
+} /* collectNames */
+
+/* Function callerName returns the index of name
+ * in the caller's names, or -1
+ */
+static int callerName( char * name)
+{ int i;
+  for (i = 0; i < ncallerNames; i++)
+    if (strcmp(callerNames[i],name) == 0) return i;
+  return -1;
+} /* callerName */
+
+/* Function freshName returns a name for a copy
+ * of name; source identifiers have no '_', so it
+ * cannot clash with them
+ */
+static char * freshName( char * name)
+{ char * s = (char *) malloc(strlen(name) + 16);
+  sprintf(s,"%s_%d",name,++freshNo);
+  return s;
+} /* freshName */
+
+/* Function copyTree returns a copy of the tree t
+ * and its siblings
+ */
+static TreeNode * copyTree( TreeNode * t)
+{ TreeNode * c;
+  int i;
+  if (t == NULL) return NULL;
+  c = (TreeNode *) malloc(sizeof(TreeNode));
+  *c = *t;
+  for (i = 0; i < MAXCHILDREN; i++)
+    c->child[i] = copyTree(t->child[i]);
+  c->sibling = copyTree(t->sibling);
+  return c;
+} /* copyTree */
+
+/* Function newVar returns an access to the
+ * integer variable name
+ */
+static TreeNode * newVar( char * name, int lineno)
+{ TreeNode * t = newExpNode(VarAccessK);
+  t->attr.name = name;
+  t->type = Integer;
+  t->lineno = lineno;
+  return t;
+} /* newVar */
+
+/* Function newDecl returns the declaration of
+ * the integer variable name
+ */
+static TreeNode * newDecl( char * name, int lineno)
+{ TreeNode * t = newStmtNode(VarDeclK);
+  t->attr.name = name;
+  t->type = Integer;
+  t->lineno = lineno;
+  return t;
+} /* newDecl */
+
+/* Function newBlock returns a compound statement
+ * without declarations around the list stmts
+ */
+static TreeNode * newBlock( TreeNode * stmts, int lineno)
+{ TreeNode * t = newStmtNode(CompoundK);
+  t->child[1] = stmts;
+  t->lineno = lineno;
+  return t;
+} /* newBlock */
+
+/* Function append returns list a followed by b */
+static TreeNode * append( TreeNode * a, TreeNode * b)
+{ TreeNode * t = a;
+  if (a == NULL) return b;
+  while (t->sibling != NULL) t = t->sibling;
+  t->sibling = b;
+  return a;
+} /* append */
+
+/* Function hasReturn returns TRUE if statement t
+ * contains a return
+ */
+static int hasReturn( TreeNode * t)
+{ TreeNode * p;
+  int i;
+  if ((t->nodekind == StmtK) && (t->kind.stmt == ReturnK)) return TRUE;
+  for (i = 0; i < MAXCHILDREN; i++)
+    for (p = t->child[i]; p != NULL; p = p->sibling)
+      if (hasReturn(p)) return TRUE;
+  return FALSE;
+} /* hasReturn */
+
+static int tailStmt( TreeNode * t);
+
+/* Function tailList rewrites the statement list
+ * at *list so that every return ends it, moving
+ * the statements after "if (c) return x;" into
+ * an else part; it returns FALSE if a return
+ * stays inside a loop or before other statements
+ */
+static int tailList( TreeNode ** list)
+{ TreeNode * t, * rest;
+  for (; (t = *list) != NULL; list = &t->sibling)
+  { if (! hasReturn(t)) continue;
+    rest = t->sibling;
+    if (rest == NULL) return tailStmt(t);
+    if (stmtEnds(t)) t->sibling = NULL;
+    else if ((t->kind.stmt == IfK) && listEnds(t->child[1]))
+    { t->kind.stmt = IfElseK;
+      t->child[2] = newBlock(rest,rest->lineno);
+    }
+    else if ((t->kind.stmt == IfElseK) && listEnds(t->child[1]))
+      t->child[2] = newBlock(append(t->child[2],rest),rest->lineno);
+    else if ((t->kind.stmt == IfElseK) && listEnds(t->child[2]))
+      t->child[1] = newBlock(append(t->child[1],rest),rest->lineno);
+    else return FALSE;
+    t->sibling = NULL;
+    return tailStmt(t);
+  }
+  return TRUE;
+} /* tailList */
+
+/* Function tailStmt does the work of tailList
+ * for the last statement t of a list
+ */
+static int tailStmt( TreeNode * t)
+{ if (t->nodekind != StmtK) return TRUE;
+  switch (t->kind.stmt) {
+    case CompoundK :
+      return tailList(&t->child[1]);
+    case IfK :
+    case IfElseK :
+      return tailList(&t->child[1]) && tailList(&t->child[2]);
+    case WhileK :
+      return ! hasReturn(t);
+    default :
+      return TRUE;
+  }
+} /* tailStmt */
+
+/* Procedure pushName renames old to new in the
+ * copy of the callee
+ */
+static void pushName( char * old, char * new)
+{ if (nrenamed == maxRenamed)
+  { maxRenamed = 2 * maxRenamed + 16;
+    oldNames = (char **) realloc(oldNames,maxRenamed * sizeof(char *));
+    newNames = (char **) realloc(newNames,maxRenamed * sizeof(char *));
+  }
+  oldNames[nrenamed] = old;
+  newNames[nrenamed++] = new;
+} /* pushName */
+
+/* Procedure renameDecls gives the declarations
+ * of the list t fresh names
+ */
+static void renameDecls( TreeNode * t)
+{ for (; t != NULL; t = t->sibling)
+  { char * name = freshName(t->attr.name);
+    pushName(t->attr.name,name);
+    t->attr.name = name;
+  }
+} /* renameDecls */
+
+/* Function renameUses renames the variables of
+ * the callee copy t and its siblings; it returns
+ * FALSE if a global it uses is hidden by a name
+ * of the caller
+ */
+static int renameUses( TreeNode * t)
+{ int i, saved;
+  for (; t != NULL; t = t->sibling)
+  { if ((t->nodekind == StmtK) && (t->kind.stmt == CompoundK))
+    { saved = nrenamed;
+      renameDecls(t->child[0]);
+      if (! renameUses(t->child[1])) return FALSE;
+      nrenamed = saved;
+      continue;
+    }
+    if ((t->nodekind == ExpK) &&
+        ((t->kind.exp == VarAccessK) || (t->kind.exp == CallK)))
+    { for (i = nrenamed - 1; i >= 0; i--)
+        if (strcmp(oldNames[i],t->attr.name) == 0) break;
+      if ((i >= 0) && (t->kind.exp == VarAccessK))
+        t->attr.name = newNames[i];
+      else if ((i >= 0) || (callerName(t->attr.name) >= 0))
+        return FALSE;
+    }
+    for (i = 0; i < MAXCHILDREN; i++)
+      if (! renameUses(t->child[i])) return FALSE;
+  }
+  return TRUE;
+} /* renameUses */
+
+/* Procedure resultTo makes the returns of the
+ * tail-form list at *list store their value in
+ * the variable target, or evaluate it for its
+ * effects when target is NULL
+ */
+static void resultTo( TreeNode ** list, char * target)
+{ TreeNode * t;
+  while ((t = *list) != NULL)
+  { if ((t->nodekind == StmtK) && (t->kind.stmt == ReturnK))
+    { if ((t->child[0] == NULL) || ((target == NULL) && isPure(t->child[0])))
+      { *list = t->sibling;
+        continue;
+      }
+      if (target == NULL) *t = *t->child[0];
+      else
+      { t->nodekind = ExpK;
+        t->kind.exp = AssignK;
+        t->child[1] = t->child[0];
+        t->child[0] = newVar(target,t->lineno);
+        t->type = Integer;
+      }
+      t->sibling = NULL;
+    }
+    else if (t->nodekind == StmtK)
+      switch (t->kind.stmt) {
+        case CompoundK :
+          resultTo(&t->child[1],target);
+          break;
+        case IfK :
+        case IfElseK :
+          resultTo(&t->child[1],target);
+          resultTo(&t->child[2],target);
+          break;
+        default :
+          break;
+      }
+    list = &t->sibling;
+  }
+} /* resultTo */
+
+/* Function expandCall returns a compound
+ * statement doing the call t, or NULL if the
+ * callee cannot be inlined here. Its returns are
+ * kept if keep is TRUE; otherwise they store
+ * their value in the variable target, or only
+ * evaluate it if target is NULL.
+ */
+static TreeNode * expandCall( TreeNode * t, char * target, int keep, int * growth)
+{ TreeNode * f, * body, * p, * a, * next, * set;
+  TreeNode * decls = NULL, * assigns = NULL;
+  int i, size;
+  if (((i = cgLookup(graph,t->attr.name)) < 0) || graph->node[i].recursive ||
+      ((f = graph->node[i].tree) == NULL))
+    return NULL;
+  size = countNodes(f->child[1]);
+  if ((size > sizeBudget) || (*growth + size > growthBudget))
+    return NULL;
+  body = copyTree(f->child[1]);
+  if (! tailList(&body->child[1])) return NULL;
+  if ((f->type != Void) && ! listEnds(body->child[1])) return NULL;
+  nrenamed = 0;
+  for (p = f->child[0], a = t->child[0]; a != NULL; p = p->sibling, a = a->sibling)
+    if (p->type == Integer) pushName(p->attr.name,freshName(p->attr.name));
+    else if ((a->kind.exp == VarAccessK) && (a->child[0] == NULL))
+      pushName(p->attr.name,a->attr.name);
+    else return NULL;
+  renameDecls(body->child[0]);
+  if (! renameUses(body->child[1])) return NULL;
+  /* the parameters become locals set from the arguments */
+  for (p = f->child[0], a = t->child[0], i = 0; a != NULL; p = p->sibling, a = next, i++)
+  { next = a->sibling;
+    a->sibling = NULL;
+    if (p->type != Integer) continue;
+    decls = append(decls,newDecl(newNames[i],t->lineno));
+    set = newExpNode(AssignK);
+    set->child[0] = newVar(newNames[i],t->lineno);
+    set->child[1] = a;
+    set->type = Integer;
+    set->lineno = t->lineno;
+    assigns = append(assigns,set);
+  }
+  if (! keep) resultTo(&body->child[1],target);
+  body->child[0] = append(decls,body->child[0]);
+  body->child[1] = append(assigns,body->child[1]);
+  body->lineno = t->lineno;
+  *growth += countNodes(body);
+  inlined++;
+  if (TraceAnalyze)
+    fprintf(listing,"  line %d: inlined call to %s\n",t->lineno,t->attr.name);
+  return body;
+} /* expandCall */
+
+/* Function isSafe returns TRUE if the value of
+ * expression t, whose operands are safe, cannot
+ * change by a call and computing it cannot fault,
+ * so it may be computed after a call instead of
+ * before: a constant or a scalar of the caller
+ */
+static int isSafe( TreeNode * t)
+{ extern ScopeList globalScope;
+  int i;
+  switch (t->kind.exp) {
+    case ConstK :
+      return TRUE;
+    case OpK :
+      return (t->attr.op != OVER) || isSafeDivisor(t->child[1]);
+    case VarAccessK :
+      return (t->child[0] == NULL) && ((i = callerName(t->attr.name)) >= 0) &&
+             ! callerArr[i] && (st_lookup(globalScope,t->attr.name) == NULL);
+    default :
+      return FALSE;
+  }
+} /* isSafe */
+
+/* Function hoist looks in expression t, in the
+ * order of evaluation, for a call that can be
+ * moved before the statement: everything
+ * evaluated before it is safe while *ok is TRUE.
+ * It returns the inlined call, replaced in t by
+ * the variable holding its result, or NULL.
+ */
+static TreeNode * hoist( TreeNode * t, TreeNode ** decl, int * ok, int * growth)
+{ TreeNode * p, * b;
+  char * name;
+  int i, wasOk;
+  if (t == NULL) return NULL;
+  switch (t->kind.exp) {
+    case CallK :
+      wasOk = *ok;
+      for (p = t->child[0]; p != NULL; p = p->sibling)
+        if ((b = hoist(p,decl,ok,growth)) != NULL) return b;
+      if (wasOk)
+      { name = freshName(t->attr.name);
+        if ((b = expandCall(t,name,FALSE,growth)) != NULL)
+        { p = t->sibling;
+          *t = *newVar(name,t->lineno);
+          t->sibling = p;
+          *decl = newDecl(name,t->lineno);
+          addCallerName(name,FALSE);
+          return b;
+        }
+      }
+      *ok = FALSE;
+      return NULL;
+    case AssignK :
+      if ((b = hoist(t->child[0]->child[0],decl,ok,growth)) != NULL) return b;
+      if ((b = hoist(t->child[1],decl,ok,growth)) != NULL) return b;
+      *ok = FALSE;
+      return NULL;
+    default :
+      for (i = 0; i < MAXCHILDREN; i++)
+        if ((b = hoist(t->child[i],decl,ok,growth)) != NULL) return b;
+      if (! isSafe(t)) *ok = FALSE;
+      return NULL;
+  }
+} /* hoist */
+
+static void inlineList( TreeNode ** list, int * growth);
+
+/* Procedure inlineStmt inlines the calls of the
+ * statement at *t. A call making up the
+ * statement, the value of an assignment to a
+ * variable or of a return is replaced by the
+ * body; other calls are moved before the
+ * statement into a block declaring their results.
+ */
+static void inlineStmt( TreeNode ** t, int * growth)
+{ TreeNode * s = *t, * e = NULL, * b, * decl, * block = NULL, ** before = t;
+  int ok;
+  if (s->nodekind == ExpK) e = s;
+  else if ((s->kind.stmt == IfK) || (s->kind.stmt == IfElseK) || (s->kind.stmt == ReturnK))
+    e = s->child[0];
+  b = NULL;
+  if ((e == s) && (e->kind.exp == CallK))
+    b = expandCall(e,NULL,FALSE,growth);
+  else if ((e == s) && (e->kind.exp == AssignK) && (e->child[0]->child[0] == NULL) &&
+           (e->child[1]->kind.exp == CallK))
+    b = expandCall(e->child[1],e->child[0]->attr.name,FALSE,growth);
+  else if ((e != NULL) && (s->nodekind == StmtK) && (s->kind.stmt == ReturnK) &&
+           (e->kind.exp == CallK))
+    b = expandCall(e,NULL,TRUE,growth);
+  if (b != NULL)
+  { b->sibling = s->sibling;
+    *t = b;
+  }
+  else
+    for (ok = TRUE; (e != NULL) && ((b = hoist(e,&decl,&ok,growth)) != NULL); ok = TRUE)
+    { if (block == NULL)
+      { block = newBlock(s,s->lineno);
+        block->sibling = s->sibling;
+        s->sibling = NULL;
+        *t = block;
+        before = &block->child[1];
+      }
+      block->child[0] = append(block->child[0],decl);
+      b->sibling = *before;
+      *before = b;
+      before = &b->sibling;
+    }
+  s = *t;
+  if (s->nodekind == StmtK)
+    switch (s->kind.stmt) {
+      case CompoundK :
+        inlineList(&s->child[1],growth);
+        break;
+      case IfK :
+      case IfElseK :
+        inlineList(&s->child[1],growth);
+        inlineList(&s->child[2],growth);
+        break;
+      case WhileK :
+        inlineList(&s->child[1],growth);
+        break;
+      default :
+        break;
+    }
+} /* inlineStmt */
+
+/* Procedure inlineList inlines the calls of the
+ * statement list at *list
+ */
+static void inlineList( TreeNode ** list, int * growth)
+{ for (; *list != NULL; list = &(*list)->sibling)
+    inlineStmt(list,growth);
+} /* inlineList */
+
+/* Function inlineCalls replaces calls of small
+ * non-recursive functions by their bodies and
+ * returns the number of calls replaced
+ */
+int inlineCalls(TreeNode * syntaxTree, int size, int growth)
+{ TreeNode * t;
+  int added;
+  sizeBudget = size;
+  growthBudget = growth;
+  inlined = 0;
+  graph = buildCallGraph(syntaxTree);
+  for (t = syntaxTree; t != NULL; t = t->sibling)
+    if ((t->nodekind == StmtK) && (t->kind.stmt == FuncDeclK))
+    { ncallerNames = 0;
+      collectNames(t->child[0]);
+      collectNames(t->child[1]);
+      added = 0;
+      inlineList(&t->child[1]->child[1],&added);
+    }
+  freeCallGraph(graph);
+  if (TraceAnalyze)
+    fprintf(listing,"Inlining expanded %d calls\n",inlined);
+  return inlined;
+}
+
+/* functions main cannot call, found by
+ * skipDeadFunctions
+ */
+static TreeNode ** deadFuncs = NULL;
+static int ndeadFuncs = 0;
+
+/* Function skipDeadFunctions finds the functions
+ * main cannot call and replaces their bodies by
+ * empty ones, so that only their signatures are
+ * analyzed; it returns their number
+ */
+int skipDeadFunctions(TreeNode * syntaxTree)
+{ CallGraph g = buildCallGraph(syntaxTree);
+  TreeNode * t;
+  int i;
+  ndeadFuncs = 0;
+  if (cgLookup(g,"main") >= 0)
+  { deadFuncs = (TreeNode **) realloc(deadFuncs,g->nnodes * sizeof(TreeNode *));
+    for (i = 0; i < g->nnodes; i++)
+      if (((t = g->node[i].tree) != NULL) && ! g->node[i].reachable)
+      { if (TraceAnalyze)
+          fprintf(listing,"  line %d: function %s is never called\n",t->lineno,t->attr.name);
+        t->child[1] = newBlock(NULL,t->child[1]->lineno);
+        deadFuncs[ndeadFuncs++] = t;
+      }
+  }
+  freeCallGraph(g);
+  if (TraceAnalyze)
+    fprintf(listing,"Dead function elimination removed %d functions\n",ndeadFuncs);
+  return ndeadFuncs;
+}
+
+/* Function removeDeadFunctions unlinks the
+ * functions found by skipDeadFunctions, which
+ * are in source order, from the syntax tree and
+ * returns the tree
+ */
+TreeNode * removeDeadFunctions(TreeNode * syntaxTree)
+{ TreeNode ** p = &syntaxTree;
+  int i = 0;
+  while ((*p != NULL) && (i < ndeadFuncs))
+    if (*p == deadFuncs[i])
+    { *p = (*p)->sibling;
+      i++;
+    }
+    else p = &(*p)->sibling;
+  return syntaxTree;
+}
+
+/* the loop being moved from, the expressions
+ * moved before it and the variables holding them
+ */
+static LoopInfo loop;
+static TreeNode ** movedExps = NULL;
+static char ** movedNames = NULL;
+static int nmoved = 0, maxMoved = 0;
+static int moved = 0;
+
+/* Procedure moveExp replaces the largest
+ * invariant operations of the expression t, in
+ * scope, by variables set before the loop; an
+ * operation written alike reuses the variable
+ */
+static void moveExp( TreeNode * t, ScopeList scope)
+{ TreeNode * e, * p;
+  int i;
+  if ((t->kind.exp == OpK) && isLoopInvariant(t,scope,&loop))
+  { for (i = 0; i < nmoved; i++)
+      if (sameExp(movedExps[i],t)) break;
+    if (i == nmoved)
+    { if (nmoved == maxMoved)
+      { maxMoved = 2 * maxMoved + 16;
+        movedExps = (TreeNode **) realloc(movedExps,maxMoved * sizeof(TreeNode *));
+        movedNames = (char **) realloc(movedNames,maxMoved * sizeof(char *));
+      }
+      e = (TreeNode *) malloc(sizeof(TreeNode));
+      *e = *t;
+      e->sibling = NULL;
+      movedExps[nmoved] = e;
+      movedNames[nmoved++] = freshName("inv");
+      moved++;
+      if (TraceAnalyze)
+        fprintf(listing,"  line %d: moved loop invariant into %s\n",t->lineno,movedNames[i]);
+    }
+    p = t->sibling;
+    *t = *newVar(movedNames[i],t->lineno);
+    t->sibling = p;
+    return;
+  }
+  for (i = 0; i < MAXCHILDREN; i++)
+    for (p = t->child[i]; p != NULL; p = p->sibling)
+      moveExp(p,scope);
+} /* moveExp */
+
+/* Procedure moveStmts moves the invariants of
+ * the statement list t, in scope
+ */
+static void moveStmts( TreeNode * t, ScopeList scope)
+{ for (; t != NULL; t = t->sibling)
+    if (t->nodekind == ExpK) moveExp(t,scope);
+    else
+      switch (t->kind.stmt) {
+        case CompoundK :
+          moveStmts(t->child[1],findScope(t,scope));
+          break;
+        case IfK :
+        case IfElseK :
+        case WhileK :
+        case ReturnK :
+          if (t->child[0] != NULL) moveExp(t->child[0],scope);
+          moveStmts(t->child[1],scope);
+          moveStmts(t->child[2],scope);
+          break;
+        default :
+          break;
+      }
+} /* moveStmts */
+
+/* Procedure moveLoop moves the invariants of the
+ * while statement at *p, in scope, into a block
+ * that sets them before the loop
+ */
+static void moveLoop( TreeNode ** p, ScopeList scope)
+{ TreeNode * w = *p, * block, * set;
+  TreeNode * decls = NULL, * sets = NULL;
+  int i;
+  scanLoop(w,scope,&loop);
+  nmoved = 0;
+  moveExp(w->child[0],scope);
+  moveStmts(w->child[1],scope);
+  if (nmoved == 0) return;
+  for (i = 0; i < nmoved; i++)
+  { decls = append(decls,newDecl(movedNames[i],w->lineno));
+    set = newExpNode(AssignK);
+    set->child[0] = newVar(movedNames[i],w->lineno);
+    set->child[1] = movedExps[i];
+    set->type = Integer;
+    set->lineno = w->lineno;
+    sets = append(sets,set);
+  }
+  block = newBlock(append(sets,w),w->lineno);
+  block->child[0] = decls;
+  block->sibling = w->sibling;
+  w->sibling = NULL;
+  *p = block;
+} /* moveLoop */
+
+/* Procedure moveList moves the invariants of the
+ * loops in the statement list at *list, in
+ * scope, outer loops first
+ */
+static void moveList( TreeNode ** list, ScopeList scope)
+{ TreeNode * t;
+  for (; (t = *list) != NULL; list = &(*list)->sibling)
+    if (t->nodekind == StmtK)
+      switch (t->kind.stmt) {
+        case CompoundK :
+          moveList(&t->child[1],findScope(t,scope));
+          break;
+        case IfK :
+        case IfElseK :
+          moveList(&t->child[1],scope);
+          moveList(&t->child[2],scope);
+          break;
+        case WhileK :
+          moveLoop(list,scope);
+          moveList(&t->child[1],scope);
+          break;
+        default :
+          break;
+      }
+} /* moveList */
+
+/* Function moveInvariants moves the invariant
+ * expressions of while loops before the loop and
+ * returns their number
+ */
+int moveInvariants(TreeNode * syntaxTree)
+{ extern ScopeList globalScope;
+  TreeNode * t;
+  moved = 0;
+  for (t = syntaxTree; t != NULL; t = t->sibling)
+    if ((t->nodekind == StmtK) && (t->kind.stmt == FuncDeclK))
+      moveList(&t->child[1]->child[1],findScope(t,globalScope));
+  if (TraceAnalyze)
+    fprintf(listing,"Loop invariant code motion moved %d expressions\n",moved);
+  return moved;
+}
@@ -0,0 +1,57 @@
+/****************************************************/
+/* File: optimize.h                                 */
+/* Optimization passes on the checked syntax tree   */
+/* of the C-MINUS compiler                          */
+/****************************************************/
+
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+/* Procedure foldConstants replaces operations on
+ * constants by their value and simplifies x+0,
+ * x-0, x*1, x/1, x*0 and x-x. A division by a
+ * constant 0 is diagnosed and left to fault at
+ * run time.
+ */
+void foldConstants(TreeNode *);
+
+/* Procedure removeDeadCode removes statements
+ * that cannot be reached, constant if and while
+ * tests and expressions without effect; the
+ * removals are reported in the TraceAnalyze
+ * listing
+ */
+void removeDeadCode(TreeNode *);
+
+/* Function inlineCalls replaces the calls of
+ * non-recursive functions of at most size nodes
+ * by a copy of their body, letting no function
+ * grow by more than growth nodes, and returns
+ * the number of calls replaced. The symbol
+ * table must be built again after it.
+ */
+int inlineCalls(TreeNode *, int size, int growth);
+
+/* Function skipDeadFunctions finds the functions
+ * main cannot call, directly or not, and empties
+ * their bodies before the analysis, which then
+ * checks only their signatures. It returns their
+ * number.
+ */
+int skipDeadFunctions(TreeNode *);
+
+/* Function removeDeadFunctions removes the
+ * functions found by skipDeadFunctions from the
+ * checked syntax tree and returns the tree
+ */
+TreeNode * removeDeadFunctions(TreeNode *);
+
+/* Function moveInvariants moves the operations
+ * of while loops whose operands do not change in
+ * the loop into variables set before it, and
+ * returns the number of operations moved. The
+ * symbol table must be built again after it.
+ */
+int moveInvariants(TreeNode *);
+
+#endif
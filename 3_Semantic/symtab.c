@@ -36,8 +36,12 @@ ScopeList buildScope(char * name, ScopeList parent)
 {
   ScopeList newScope = malloc(sizeof(struct ScopeListRec));
   newScope->name = copyString(name);
+  newScope->tree = NULL;
+  newScope->frameBase = 0;
   newScope->parent = parent;
   newScope->leftMostChild = NULL;
+  newScope->rightMostChild = NULL;
+  newScope->lastFound = NULL;
   newScope->rightSibling = NULL;
   for (int i = 0; i < HASH_TBL_SIZE; i++)
   {
@@ -54,26 +58,35 @@ void addChildScope(ScopeList parent, ScopeList child)
   }
   else
   {
-    ScopeList current = parent->leftMostChild;
-    while (current->rightSibling != NULL)
-    {
-      current = current->rightSibling;
-    }
-    current->rightSibling = child;
+    parent->rightMostChild->rightSibling = child;
   }
+  parent->rightMostChild = child;
 }
 
-ScopeList findScope(char * name, ScopeList parent)
+/* Function findScope returns the child scope of
+ * parent opened by tree; compound statements on
+ * one line share their name but not their node.
+ * The passes visit the children in order, so the
+ * search goes on after the child found last.
+ */
+ScopeList findScope(TreeNode * tree, ScopeList parent)
 {
-  ScopeList current = parent->leftMostChild;
+  ScopeList start = (parent->lastFound != NULL) ? parent->lastFound->rightSibling : NULL;
+  ScopeList current;
 
-  while (current != NULL)
+  for (current = start; current != NULL; current = current->rightSibling)
+  {
+    if (current->tree == tree)
+    {
+      return parent->lastFound = current;
+    }
+  }
+  for (current = parent->leftMostChild; current != start; current = current->rightSibling)
   {
-    if (strcmp(current->name, name) == 0)
+    if (current->tree == tree)
     {
-      return current;
+      return parent->lastFound = current;
     }
-    current = current->rightSibling;
   }
 
   return NULL;
@@ -86,12 +99,14 @@ void init_symtab()
   // built-in functions
   BucketList output_bl = st_insert(globalScope, "output", Function, 0, 1);
   output_bl->func.type = Void;
+  output_bl->func.frameSize = 0;
   output_bl->func.params = 1;
   output_bl->func.param[0].name = copyString("value");
   output_bl->func.param[0].type = Integer;
 
   BucketList input_bl = st_insert(globalScope, "input", Function, 0, 0);
   input_bl->func.type = Integer;
+  input_bl->func.frameSize = 0;
   input_bl->func.params = 0;
 }
 
@@ -112,6 +127,7 @@ BucketList st_insert( ScopeList scope, char * name, ExpType type, int lineno, in
     l->lines = (LineList) malloc(sizeof(struct LineListRec));
     l->lines->lineno = lineno;
     l->memloc = loc;
+    l->isParam = FALSE;
     l->lines->next = NULL;
     l->next = scope->bucket[h];
     l->scope = scope;
@@ -16,6 +16,23 @@
 
 #define MAX_FUNC_PARAMS 127
 
+/* Memory layout, assigned by buildSymtab.
+ * Globals are at memloc from 0 up, relative
+ * to gp. Parameters and locals are at memloc
+ * relative to fp, in the activation record:
+ *    0(fp)  = control link (caller's fp)
+ *   -1(fp)  = return address
+ *   -2(fp)  = first parameter, then the rest
+ *   below   = local variables, then temps
+ * Array parameters hold the absolute address
+ * of element 0; declared arrays hold storage
+ * with element i at memloc+i. The locals of
+ * sibling compound statements share locations.
+ */
+#define ofpFO 0
+#define retFO (-1)
+#define initFO (-2)
+
 /* the list of line numbers of the source 
  * code in which a variable is referenced
  */
@@ -35,6 +52,7 @@ typedef struct BucketListRec
      ExpType type;
      LineList lines;
      int memloc ; /* memory location for variable */
+     int isParam ; /* TRUE for function parameters */
      struct {
        ExpType type;
        int params;
@@ -42,6 +60,7 @@ typedef struct BucketListRec
         char * name;
         ExpType type;
        } param[MAX_FUNC_PARAMS];
+       int frameSize; /* words of the activation record before temps */
      } func;
      struct BucketListRec * next;
      struct ScopeListRec * scope;
@@ -49,15 +68,19 @@ typedef struct BucketListRec
 
 typedef struct ScopeListRec
    { char * name;
+     TreeNode * tree ; /* FuncDeclK or CompoundK opening it */
      BucketList bucket[HASH_TBL_SIZE];
+     int frameBase ; /* first free frame location at entry */
      struct ScopeListRec * parent;
      struct ScopeListRec * leftMostChild;
+     struct ScopeListRec * rightMostChild;
+     struct ScopeListRec * lastFound; /* where findScope goes on */
      struct ScopeListRec * rightSibling;
    } * ScopeList;
 
 ScopeList buildScope(char * name, ScopeList parent);
 void addChildScope(ScopeList parent, ScopeList child);
-ScopeList findScope(char * name, ScopeList parent);
+ScopeList findScope(TreeNode * tree, ScopeList parent);
 
 void init_symtab();
 
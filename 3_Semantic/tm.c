@@ -1,6 +1,8 @@
 /****************************************************/
 /* File: tm.c                                       */
 /* The TM ("Tiny Machine") computer                 */
+/* libtm: all machine state lives in a TMContext,   */
+/* see tm.h; the command interpreter is in tmmain.c */
 /* Compiler Construction: Principles and Practice   */
 /* Kenneth C. Louden                                */
 /****************************************************/
@@ -9,22 +11,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-
-#ifndef TRUE
-#define TRUE 1
-#endif
-#ifndef FALSE
-#define FALSE 0
-#endif
-
-/******* const *******/
-#define   IADDR_SIZE  1024 /* increase for large programs */
-#define   DADDR_SIZE  1024 /* increase for large programs */
-#define   NO_REGS 8
-#define   PC_REG  7
-
-#define   LINESIZE  121
-#define   WORDSIZE  20
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <time.h>
+#include "tm.h"
 
 /******* type  *******/
 
@@ -34,59 +28,44 @@ typedef enum {
    opclRA      /* reg r, int d+s */
    } OPCLASS;
 
+/* handlers of the threaded run loop beyond the opcodes */
 typedef enum {
-   /* RR instructions */
-   opHALT,    /* RR     halt, operands are ignored */
-   opIN,      /* RR     read into reg(r); s and t are ignored */
-   opOUT,     /* RR     write from reg(r), s and t are ignored */
-   opADD,    /* RR     reg(r) = reg(s)+reg(t) */
-   opSUB,    /* RR     reg(r) = reg(s)-reg(t) */
-   opMUL,    /* RR     reg(r) = reg(s)*reg(t) */
-   opDIV,    /* RR     reg(r) = reg(s)/reg(t) */
-   opRRLim,   /* limit of RR opcodes */
-
-   /* RM instructions */
-   opLD,      /* RM     reg(r) = mem(d+reg(s)) */
-   opST,      /* RM     mem(d+reg(s)) = reg(r) */
-   opRMLim,   /* Limit of RM opcodes */
-
-   /* RA instructions */
-   opLDA,     /* RA     reg(r) = d+reg(s) */
-   opLDC,     /* RA     reg(r) = d ; reg(s) is ignored */
-   opJLT,     /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
-   opJLE,     /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
-   opJGT,     /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
-   opJGE,     /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
-   opJEQ,     /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
-   opJNE,     /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
-   opRALim    /* Limit of RA opcodes */
-   } OPCODE;
+   hLDApc = opRALim + 1, /* LDA/LDC into the pc: checked jump */
+   hLDpc,     /* LD into the pc: checked jump */
+   hSTEP,     /* rare forms, executed by stepTM */
+   /* forms whose constant address or target is proven in range */
+   hLDk, hSTk, hJMPk,
+   hJLTk, hJLEk, hJGTk, hJGEk, hJEQk, hJNEk,
+   /* superinstructions fused by fuseTM: one dispatch runs the
+    * instruction and its successor; the successor keeps its own
+    * decoding for jumps into it
+    */
+   hLDLD, hLDST, hSTLD, hLDCLD, hSTLDC, hLDCST,
+   hLDADD, hLDSUB, hLDMUL, hADDST, hSUBST, hMULST,
+   hSUBJLT, hSUBJLE, hSUBJGT, hSUBJGE, hSUBJEQ, hSUBJNE,
+   /* the compare-to-boolean block Jxx r,2(pc); LDC r,0;
+    * LDA pc,1(pc); LDC r,1 in one dispatch
+    */
+   hBOOLLT, hBOOLLE, hBOOLGT, hBOOLGE, hBOOLEQ, hBOOLNE,
+   hLim
+   } HANDLER;
 
-typedef enum {
-   srOKAY,
-   srHALT,
-   srIMEM_ERR,
-   srDMEM_ERR,
-   srZERODIVIDE
-   } STEPRESULT;
+/* pre-decoded instruction for the threaded run loop:
+ * handler is the address of the routine in runTM,
+ * a base register of ZERO_REG marks an address
+ * already made absolute at load time
+ */
+typedef struct tmdecoded {
+      void * handler ;
+      int op ;  /* opcode or HANDLER */
+      int fop ; /* op, or the superinstruction runTM executes */
+      int r, s, t ;
+      int d ;
+   } DECODED;
 
-typedef struct {
-      int iop  ;
-      int iarg1  ;
-      int iarg2  ;
-      int iarg3  ;
-   } INSTRUCTION;
+#define   ZERO_REG  NO_REGS
 
 /******** vars ********/
-int iloc = 0 ;
-int dloc = 0 ;
-int traceflag = FALSE;
-int icountflag = FALSE;
-
-INSTRUCTION iMem [IADDR_SIZE];
-int dMem [DADDR_SIZE];
-int reg [NO_REGS];
-
 char * opCodeTab[]
         = {"HALT","IN","OUT","ADD","SUB","MUL","DIV","????",
             /* RR opcodes */
@@ -95,226 +74,598 @@ char * opCodeTab[]
            /* RA opcodes */
           };
 
+/* names of the superinstructions, from hLDLD */
+static char * fuseNameTab[]
+        = {"LD+LD","LD+ST","ST+LD","LDC+LD","ST+LDC","LDC+ST",
+           "LD+ADD","LD+SUB","LD+MUL","ADD+ST","SUB+ST","MUL+ST",
+           "SUB+JLT","SUB+JLE","SUB+JGT","SUB+JGE","SUB+JEQ","SUB+JNE",
+           "JLT/LDC/LDA/LDC","JLE/LDC/LDA/LDC","JGT/LDC/LDA/LDC",
+           "JGE/LDC/LDA/LDC","JEQ/LDC/LDA/LDC","JNE/LDC/LDA/LDC"
+          };
+
 char * stepResultTab[]
         = {"OK","Halted","Instruction Memory Fault",
-           "Data Memory Fault","Division by 0"
+           "Data Memory Fault","Division by 0","Input Error",
+           "Instruction Limit Exceeded","Time Limit Exceeded",
+           "Breakpoint","Division Overflow"
           };
 
-char pgmName[20];
-FILE *pgm  ;
-
-char in_Line[LINESIZE] ;
-int lineLen ;
-int inCol  ;
-int num  ;
-char word[WORDSIZE] ;
-char ch  ;
-int done  ;
-
 /********************************************/
-int opClass( int c )
+static int opClass( int c )
 { if      ( c <= opRRLim) return ( opclRR );
   else if ( c <= opRMLim) return ( opclRM );
   else                    return ( opclRA );
 } /* opClass */
 
 /********************************************/
-void writeInstruction ( int loc )
-{ printf( "%5d: ", loc) ;
-  if ( (loc >= 0) && (loc < IADDR_SIZE) )
-  { printf("%6s%3d,", opCodeTab[iMem[loc].iop], iMem[loc].iarg1);
-    switch ( opClass(iMem[loc].iop) )
-    { case opclRR: printf("%1d,%1d", iMem[loc].iarg2, iMem[loc].iarg3);
-                   break;
-      case opclRM:
-      case opclRA: printf("%3d(%1d)", iMem[loc].iarg2, iMem[loc].iarg3);
-                   break;
-    }
-    printf ("\n") ;
+/* writeInstruction writes the instruction   */
+/* at loc without ending the line; FALSE if  */
+/* loc is outside iMem.                      */
+/********************************************/
+static int writeInstruction ( TMContext * tm, FILE * f, int loc )
+{ INSTRUCTION * in;
+  fprintf(f, "%5d: ", loc) ;
+  if ( (loc < 0) || (loc >= tm->iaddrSize) ) return FALSE;
+  in = &tm->iMem[loc];
+  fprintf(f, "%6s%3d,", opCodeTab[in->iop], in->iarg1);
+  switch ( opClass(in->iop) )
+  { case opclRR: fprintf(f, "%1d,%1d", in->iarg2, in->iarg3);
+                 break;
+    case opclRM:
+    case opclRA: fprintf(f, "%3d(%1d)", in->iarg2, in->iarg3);
+                 break;
   }
+  return TRUE;
 } /* writeInstruction */
 
 /********************************************/
-void getCh (void)
-{ if (++inCol < lineLen)
-  ch = in_Line[inCol] ;
-  else ch = ' ' ;
+void tmWriteInstruction ( TMContext * tm, FILE * f, int loc )
+{ if ( writeInstruction (tm, f, loc) ) fprintf (f, "\n") ;
+} /* tmWriteInstruction */
+
+/********************************************/
+static void getCh ( TMContext * tm )
+{ if (++tm->inCol < tm->lineLen)
+  tm->ch = tm->line[tm->inCol] ;
+  else tm->ch = ' ' ;
 } /* getCh */
 
 /********************************************/
-int nonBlank (void)
-{ while ((inCol < lineLen)
-         && (in_Line[inCol] == ' ') )
-    inCol++ ;
-  if (inCol < lineLen)
-  { ch = in_Line[inCol] ;
+static int nonBlank ( TMContext * tm )
+{ while ((tm->inCol < tm->lineLen)
+         && (tm->line[tm->inCol] == ' ') )
+    tm->inCol++ ;
+  if (tm->inCol < tm->lineLen)
+  { tm->ch = tm->line[tm->inCol] ;
     return TRUE ; }
   else
-  { ch = ' ' ;
+  { tm->ch = ' ' ;
     return FALSE ; }
 } /* nonBlank */
 
 /********************************************/
-int getNum (void)
+int tmGetNum ( TMContext * tm )
 { int sign;
   int term;
   int temp = FALSE;
-  num = 0 ;
+  tm->num = 0 ;
   do
   { sign = 1;
-    while ( nonBlank() && ((ch == '+') || (ch == '-')) )
+    while ( nonBlank(tm) && ((tm->ch == '+') || (tm->ch == '-')) )
     { temp = FALSE ;
-      if (ch == '-')  sign = - sign ;
-      getCh();
+      if (tm->ch == '-')  sign = - sign ;
+      getCh(tm);
     }
     term = 0 ;
-    nonBlank();
-    while (isdigit(ch))
+    nonBlank(tm);
+    while (isdigit(tm->ch))
     { temp = TRUE ;
-      term = term * 10 + ( ch - '0' ) ;
-      getCh();
+      term = term * 10 + ( tm->ch - '0' ) ;
+      getCh(tm);
     }
-    num = num + (term * sign) ;
-  } while ( (nonBlank()) && ((ch == '+') || (ch == '-')) ) ;
+    tm->num = tm->num + (term * sign) ;
+  } while ( (nonBlank(tm)) && ((tm->ch == '+') || (tm->ch == '-')) ) ;
   return temp;
-} /* getNum */
+} /* tmGetNum */
 
 /********************************************/
-int getWord (void)
+int tmGetWord ( TMContext * tm )
 { int temp = FALSE;
   int length = 0;
-  if (nonBlank ())
-  { while (isalnum(ch))
-    { if (length < WORDSIZE-1) word [length++] =  ch ;
-      getCh() ;
+  if (nonBlank (tm))
+  { while (isalnum(tm->ch))
+    { if (length < WORDSIZE-1) tm->word [length++] =  tm->ch ;
+      getCh(tm) ;
     }
-    word[length] = '\0';
+    tm->word[length] = '\0';
     temp = (length != 0);
   }
   return temp;
-} /* getWord */
+} /* tmGetWord */
 
 /********************************************/
-int skipCh ( char c  )
+int tmSkipCh ( TMContext * tm, char c  )
 { int temp = FALSE;
-  if ( nonBlank() && (ch == c) )
-  { getCh();
+  if ( nonBlank(tm) && (tm->ch == c) )
+  { getCh(tm);
     temp = TRUE;
   }
   return temp;
-} /* skipCh */
+} /* tmSkipCh */
 
 /********************************************/
-int atEOL(void)
-{ return ( ! nonBlank ());
-} /* atEOL */
+int tmAtEOL ( TMContext * tm )
+{ return ( ! nonBlank (tm));
+} /* tmAtEOL */
 
 /********************************************/
-int error( char * msg, int lineNo, int instNo)
-{ printf("Line %d",lineNo);
-  if (instNo >= 0) printf(" (Instruction %d)",instNo);
-  printf("   %s\n",msg);
+/* error records why loading failed in       */
+/* errMsg and returns FALSE.                 */
+/********************************************/
+static int error( TMContext * tm, char * msg, int lineNo, int instNo)
+{ char * p = tm->errMsg;
+  *p = '\0';
+  if (lineNo > 0) p += sprintf(p, "Line %d ",lineNo);
+  if (instNo >= 0) p += sprintf(p, "(Instruction %d)",instNo);
+  sprintf(p, "   %s",msg);
   return FALSE;
 } /* error */
 
+/* bytes of dMem, in whole pages */
+static size_t dMemLen ( TMContext * tm, size_t page )
+{ return ((size_t) tm->daddrSize * sizeof(int) + page - 1) / page * page;
+}
+
+/********************************************/
+/* zeroDMem gives the pages of dMem back to  */
+/* the system, which supplies zeroed pages   */
+/* on the next access.                       */
+/********************************************/
+static void zeroDMem ( TMContext * tm )
+{ size_t page = sysconf(_SC_PAGESIZE);
+  if ( madvise(tm->dMem, dMemLen(tm, page), MADV_DONTNEED) != 0 )
+    memset(tm->dMem, 0, (size_t) tm->daddrSize * sizeof(int));
+} /* zeroDMem */
+
+/********************************************/
+/* clearDMem zeroes dMem and sets the        */
+/* initial stack top in dMem[0].             */
+/********************************************/
+static void clearDMem ( TMContext * tm )
+{ zeroDMem (tm);
+  tm->dMem[0] = tm->daddrSize - 1 ;
+} /* clearDMem */
+
+/******** profiler ********/
+
+/* line table record read from the program:
+ * locations from..to come from source line
+ * line; a record with a name is the entry
+ * of that function
+ */
+typedef struct {
+      int from, to ;
+      int line ;
+      char * name ;
+      int lineNo ;  /* of the record in the program file */
+   } PROFREC;
+
+/* per-location execution counts */
+typedef struct {
+      long count ;
+      long taken ;  /* branches only */
+      int line ;
+      int func ;
+   } PROFLOC;
+
+/* node of the call tree: one per distinct stack of functions */
+typedef struct callnode {
+      int func ;
+      long self ;   /* instructions executed with this stack */
+      struct callnode * parent, * child, * sibling ;
+   } CALLNODE;
+
+typedef struct tmprof {
+      PROFREC * rec ;
+      int nRec ;
+      PROFLOC * loc ;
+      char ** func ;   /* function names */
+      int * entry ;    /* function entry locations */
+      int nFunc ;
+      CALLNODE * root ;
+      CALLNODE * cur ;
+      /* shadow call stack: caller node and return location */
+      CALLNODE ** stkNode ;
+      int * stkRet ;
+      int depth, stkSize ;
+   } TMPROF;
+
+/********************************************/
+/* profRecord stores a "*@ func <entry>      */
+/* <name>" or "*@ line <from> <to> <line>"   */
+/* record of the line table emitted by the   */
+/* code generator, read from line lineNo of  */
+/* the program. profInit checks it.          */
 /********************************************/
-int readInstructions (void)
+static void profRecord ( TMPROF * pr, char * line, int lineNo )
+{ PROFREC r;
+  char name[LINESIZE];
+  r.name = NULL;
+  r.lineNo = lineNo;
+  if ( sscanf(line, "*@ func %d %120s", &r.from, name) == 2 )
+  { r.to = r.from;
+    r.line = 0;
+    r.name = (char *) malloc(strlen(name)+1);
+    strcpy(r.name, name);
+  }
+  else if ( sscanf(line, "*@ line %d %d %d", &r.from, &r.to, &r.line) != 3 )
+    return;
+  pr->rec = (PROFREC *) realloc(pr->rec, (pr->nRec+1) * sizeof(PROFREC));
+  pr->rec[pr->nRec++] = r;
+} /* profRecord */
+
+/********************************************/
+static int readInstructions ( TMContext * tm, FILE * pgm )
 { OPCODE op;
   int arg1, arg2, arg3;
   int loc, regNo, lineNo;
   for (regNo = 0 ; regNo < NO_REGS ; regNo++)
-      reg[regNo] = 0 ;
-  dMem[0] = DADDR_SIZE - 1 ;
-  for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-      dMem[loc] = 0 ;
-  for (loc = 0 ; loc < IADDR_SIZE ; loc++)
-  { iMem[loc].iop = opHALT ;
-    iMem[loc].iarg1 = 0 ;
-    iMem[loc].iarg2 = 0 ;
-    iMem[loc].iarg3 = 0 ;
-  }
+      tm->reg[regNo] = 0 ;
+  tm->dMem[0] = tm->daddrSize - 1 ;
+  tm->codeSize = 0 ;
   lineNo = 0 ;
-  while (! feof(pgm))
-  { fgets( in_Line, LINESIZE-2, pgm  ) ;
-    inCol = 0 ; 
+  while ( fgets( tm->line, LINESIZE-2, pgm ) != NULL )
+  { tm->inCol = 0 ;
     lineNo++;
-    lineLen = strlen(in_Line)-1 ;
-    if (in_Line[lineLen]=='\n') in_Line[lineLen] = '\0' ;
-    else in_Line[++lineLen] = '\0';
-    if ( (nonBlank()) && (in_Line[inCol] != '*') )
-    { if (! getNum())
-        return error("Bad location", lineNo,-1);
-      loc = num;
-      if (loc > IADDR_SIZE)
-        return error("Location too large",lineNo,loc);
-      if (! skipCh(':'))
-        return error("Missing colon", lineNo,loc);
-      if (! getWord ())
-        return error("Missing opcode", lineNo,loc);
+    tm->lineLen = strlen(tm->line)-1 ;
+    if ( tm->lineLen < 0 ) tm->lineLen = 0 ;
+    if (tm->line[tm->lineLen]=='\n') tm->line[tm->lineLen] = '\0' ;
+    else tm->line[++tm->lineLen] = '\0';
+    if ( (tm->prof != NULL) && (strncmp(tm->line, "*@", 2) == 0) )
+      profRecord(tm->prof, tm->line, lineNo);
+    if ( (nonBlank(tm)) && (tm->line[tm->inCol] != '*') )
+    { if (! tmGetNum(tm))
+        return error(tm, "Bad location", lineNo,-1);
+      loc = tm->num;
+      if (loc < 0)
+        return error(tm, "Bad location", lineNo,-1);
+      if (loc >= tm->iaddrSize)
+        return error(tm, "Location too large",lineNo,loc);
+      if (! tmSkipCh(tm, ':'))
+        return error(tm, "Missing colon", lineNo,loc);
+      if (! tmGetWord (tm))
+        return error(tm, "Missing opcode", lineNo,loc);
       op = opHALT ;
       while ((op < opRALim)
-             && (strncmp(opCodeTab[op], word, 4) != 0) )
+             && (strncmp(opCodeTab[op], tm->word, 4) != 0) )
           op++ ;
-      if (strncmp(opCodeTab[op], word, 4) != 0)
-          return error("Illegal opcode", lineNo,loc);
+      if (strncmp(opCodeTab[op], tm->word, 4) != 0)
+          return error(tm, "Illegal opcode", lineNo,loc);
       switch ( opClass(op) )
       { case opclRR :
         /***********************************/
-        if ( (! getNum ()) || (num < 0) || (num >= NO_REGS) )
-            return error("Bad first register", lineNo,loc);
-        arg1 = num;
-        if ( ! skipCh(','))
-            return error("Missing comma", lineNo, loc);
-        if ( (! getNum ()) || (num < 0) || (num >= NO_REGS) )
-            return error("Bad second register", lineNo, loc);
-        arg2 = num;
-        if ( ! skipCh(',')) 
-            return error("Missing comma", lineNo,loc);
-        if ( (! getNum ()) || (num < 0) || (num >= NO_REGS) )
-            return error("Bad third register", lineNo,loc);
-        arg3 = num;
+        if ( (! tmGetNum (tm)) || (tm->num < 0) || (tm->num >= NO_REGS) )
+            return error(tm, "Bad first register", lineNo,loc);
+        arg1 = tm->num;
+        if ( ! tmSkipCh(tm, ','))
+            return error(tm, "Missing comma", lineNo, loc);
+        if ( (! tmGetNum (tm)) || (tm->num < 0) || (tm->num >= NO_REGS) )
+            return error(tm, "Bad second register", lineNo, loc);
+        arg2 = tm->num;
+        if ( ! tmSkipCh(tm, ','))
+            return error(tm, "Missing comma", lineNo,loc);
+        if ( (! tmGetNum (tm)) || (tm->num < 0) || (tm->num >= NO_REGS) )
+            return error(tm, "Bad third register", lineNo,loc);
+        arg3 = tm->num;
         break;
 
         case opclRM :
         case opclRA :
         /***********************************/
-        if ( (! getNum ()) || (num < 0) || (num >= NO_REGS) )
-            return error("Bad first register", lineNo,loc);
-        arg1 = num;
-        if ( ! skipCh(','))
-            return error("Missing comma", lineNo,loc);
-        if (! getNum ())
-            return error("Bad displacement", lineNo,loc);
-        arg2 = num;
-        if ( ! skipCh('(') && ! skipCh(',') )
-            return error("Missing LParen", lineNo,loc);
-        if ( (! getNum ()) || (num < 0) || (num >= NO_REGS))
-            return error("Bad second register", lineNo,loc);
-        arg3 = num;
+        if ( (! tmGetNum (tm)) || (tm->num < 0) || (tm->num >= NO_REGS) )
+            return error(tm, "Bad first register", lineNo,loc);
+        arg1 = tm->num;
+        if ( ! tmSkipCh(tm, ','))
+            return error(tm, "Missing comma", lineNo,loc);
+        if (! tmGetNum (tm))
+            return error(tm, "Bad displacement", lineNo,loc);
+        arg2 = tm->num;
+        if ( ! tmSkipCh(tm, '(') && ! tmSkipCh(tm, ',') )
+            return error(tm, "Missing LParen", lineNo,loc);
+        if ( (! tmGetNum (tm)) || (tm->num < 0) || (tm->num >= NO_REGS))
+            return error(tm, "Bad second register", lineNo,loc);
+        arg3 = tm->num;
         break;
         }
-      iMem[loc].iop = op;
-      iMem[loc].iarg1 = arg1;
-      iMem[loc].iarg2 = arg2;
-      iMem[loc].iarg3 = arg3;
+      tm->iMem[loc].iop = op;
+      tm->iMem[loc].iarg1 = arg1;
+      tm->iMem[loc].iarg2 = arg2;
+      tm->iMem[loc].iarg3 = arg3;
+      if ( loc >= tm->codeSize ) tm->codeSize = loc + 1 ;
     }
   }
+  /* include the HALT following the program */
+  if ( tm->codeSize < tm->iaddrSize ) tm->codeSize++ ;
   return TRUE;
 } /* readInstructions */
 
+/******** batch I/O ********/
+
+#define   IOBUFSIZE  (1 << 16)
+
+/* release the current batch input */
+static void ioClose ( TMContext * tm )
+{ if ( tm->inKind == 1 ) free(tm->inBuf);
+  else if ( tm->inKind == 2 ) munmap(tm->inBuf, tm->inLen);
+  if ( tm->inOwnFd ) close(tm->inFd);
+  tm->inFd = 0;
+  tm->inOwnFd = FALSE;
+  tm->inBuf = NULL;
+  tm->inPos = tm->inLen = 0;
+  tm->inWhole = FALSE;
+  tm->inKind = 0;
+} /* ioClose */
+
+/********************************************/
+/* tmSetInputFile sets up batch input from   */
+/* file name (stdin if NULL). Returns FALSE  */
+/* if the file cannot be opened.             */
+/********************************************/
+int tmSetInputFile ( TMContext * tm, char * name )
+{ struct stat st;
+  void * p;
+  ioClose (tm);
+  if ( name != NULL )
+  { tm->inFd = open(name, O_RDONLY);
+    if ( tm->inFd < 0 )
+    { tm->inFd = 0;
+      return FALSE;
+    }
+    tm->inOwnFd = TRUE;
+  }
+  if ( (fstat(tm->inFd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0) )
+  { p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tm->inFd, 0);
+    if ( p != MAP_FAILED )
+    { tm->inBuf = (unsigned char *) p;
+      tm->inLen = st.st_size;
+      tm->inWhole = TRUE;
+      tm->inKind = 2;
+    }
+  }
+  return TRUE;
+} /* tmSetInputFile */
+
+/********************************************/
+void tmSetInputBuffer ( TMContext * tm, const char * buf, size_t len )
+{ ioClose (tm);
+  tm->inBuf = (unsigned char *) buf;
+  tm->inLen = len;
+  tm->inWhole = TRUE;
+} /* tmSetInputBuffer */
+
+/* next input byte, or EOF */
+static int ioPeek ( TMContext * tm )
+{ ssize_t n;
+  if ( tm->inPos < tm->inLen ) return tm->inBuf[tm->inPos];
+  if ( tm->inWhole ) return EOF;
+  if ( tm->inBuf == NULL )
+  { tm->inBuf = (unsigned char *) malloc(IOBUFSIZE);
+    if ( tm->inBuf == NULL ) return EOF;
+    tm->inKind = 1;
+  }
+  do n = read(tm->inFd, tm->inBuf, IOBUFSIZE);
+  while ( (n < 0) && (errno == EINTR) );
+  if ( n <= 0 ) return EOF;
+  tm->inPos = 0;
+  tm->inLen = n;
+  return tm->inBuf[0];
+}
+
+/********************************************/
+/* ioRead reads the next value of batch      */
+/* input: a decimal integer after white      */
+/* space, or 4 raw bytes in binary mode.     */
+/********************************************/
+static STEPRESULT ioRead ( TMContext * tm, int * val )
+{ unsigned int v = 0;
+  int c, i, neg = FALSE;
+  if ( tm->binary )
+  { unsigned char b[4];
+    for (i = 0; i < 4; i++)
+    { if ( (c = ioPeek(tm)) == EOF ) return srIN_ERR;
+      b[i] = c;
+      tm->inPos++;
+    }
+    memcpy(val, b, 4);
+    return srOKAY;
+  }
+  while ( ((c = ioPeek(tm)) != EOF) && isspace(c) ) tm->inPos++;
+  if ( (c == '-') || (c == '+') )
+  { neg = (c == '-');
+    tm->inPos++;
+    c = ioPeek(tm);
+  }
+  if ( (c == EOF) || ! isdigit(c) ) return srIN_ERR;
+  do
+  { v = v * 10 + (c - '0');
+    tm->inPos++;
+  } while ( ((c = ioPeek(tm)) != EOF) && isdigit(c) );
+  *val = (int) (neg ? -v : v);
+  return srOKAY;
+} /* ioRead */
+
+/********************************************/
+/* tmFlush writes the collected output to    */
+/* outFd; output kept in memory stays.       */
+/********************************************/
+void tmFlush ( TMContext * tm )
+{ size_t done = 0;
+  ssize_t n;
+  if ( tm->outFd < 0 ) return;
+  while ( done < tm->outLen )
+  { n = write(tm->outFd, tm->outBuf + done, tm->outLen - done);
+    if ( n < 0 )
+    { if ( errno == EINTR ) continue;
+      break;
+    }
+    done += n;
+  }
+  tm->outLen = 0;
+} /* tmFlush */
+
+/********************************************/
+void tmSetOutputFd ( TMContext * tm, int fd )
+{ tmFlush (tm);
+  tm->outLen = 0;
+  tm->outFd = fd;
+} /* tmSetOutputFd */
+
+/********************************************/
+char * tmOutput ( TMContext * tm, size_t * len )
+{ *len = tm->outLen;
+  return tm->outBuf;
+} /* tmOutput */
+
+/********************************************/
+/* ioWrite appends a value to batch output:  */
+/* a decimal line, or 4 raw bytes in binary  */
+/* mode.                                     */
+/********************************************/
+static void ioWrite ( TMContext * tm, int val )
+{ char digits[12];
+  unsigned int v = (val < 0) ? - (unsigned int) val : (unsigned int) val;
+  int n = 0;
+  char * out;
+  if ( tm->outLen + 16 > tm->outSize )
+  { if ( tm->outFd >= 0 ) tmFlush (tm);
+    else
+    { out = (char *) realloc(tm->outBuf, 2 * tm->outSize);
+      if ( out == NULL ) return;
+      tm->outBuf = out;
+      tm->outSize *= 2;
+    }
+  }
+  out = tm->outBuf;
+  if ( tm->binary )
+  { memcpy(out + tm->outLen, &val, 4);
+    tm->outLen += 4;
+    return;
+  }
+  do
+  { digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while ( v != 0 );
+  if ( val < 0 ) out[tm->outLen++] = '-';
+  while ( n > 0 ) out[tm->outLen++] = digits[--n];
+  out[tm->outLen++] = '\n';
+} /* ioWrite */
+
+/******** run limits ********/
+
+/* instructions between two reads of the clock */
+#define   LIMIT_INTERVAL  (1L << 20)
 
 /********************************************/
-STEPRESULT stepTM (void)
+static double clockTM (void)
+{ struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+} /* clockTM */
+
+/********************************************/
+static int limitsSet ( TMContext * tm )
+{ return (tm->fuelLimit > 0) || (tm->timeLimit > 0);
+} /* limitsSet */
+
+/********************************************/
+/* atBreak tells if the instruction at the   */
+/* pc is a break.                            */
+/********************************************/
+static int atBreak ( TMContext * tm )
+{ int pc = tm->reg[PC_REG];
+  if ( (pc >= 0) && (pc == tm->breakAt) ) return TRUE;
+  return tm->breakIn && (pc >= 0) && (pc < tm->iaddrSize) &&
+         (tm->iMem[pc].iop == opIN);
+} /* atBreak */
+
+/********************************************/
+/* limitStart starts the clock of a run and  */
+/* returns the instruction count of its first*/
+/* limit check: 0 with limits, else never.   */
+/********************************************/
+static long limitStart ( TMContext * tm )
+{ tm->runStart = clockTM ();
+  return limitsSet (tm) ? 0 : LONG_MAX;
+} /* limitStart */
+
+/********************************************/
+/* limitCheck returns srFUEL or srTIMEOUT if */
+/* a limit is reached after executed         */
+/* instructions of the run. Otherwise it     */
+/* returns srOKAY and sets *next to the      */
+/* instructions that may run until the next  */
+/* check. The run loops call it only when    */
+/* their count passes the check point, and   */
+/* runTM only on taken jumps, which every    */
+/* non-terminating program keeps executing.  */
+/********************************************/
+static STEPRESULT limitCheck ( TMContext * tm, long executed, long * next )
+{ long n = LIMIT_INTERVAL;
+  if ( tm->fuelLimit > 0 )
+  { if ( executed >= tm->fuelLimit ) return srFUEL;
+    if ( tm->fuelLimit - executed < n ) n = tm->fuelLimit - executed;
+  }
+  if ( (tm->timeLimit > 0) && (clockTM () - tm->runStart >= tm->timeLimit) )
+    return srTIMEOUT;
+  *next = n;
+  return srOKAY;
+} /* limitCheck */
+
+/********************************************/
+/* tmLimitReport prints the state of a run   */
+/* stopped by a limit, or by a fault.        */
+/********************************************/
+void tmLimitReport ( TMContext * tm, FILE * f, STEPRESULT result )
+{ int i, pc = tm->reg[PC_REG];
+  fprintf(f, "%s after %ld instructions in %.3f s\n",
+          stepResultTab[result], tm->steps, clockTM () - tm->runStart);
+  fprintf(f, "next instruction %d", pc);
+  if ( (pc >= 0) && (pc < tm->iaddrSize) )
+  { INSTRUCTION * in = &tm->iMem[pc];
+    if ( opClass(in->iop) == opclRR )
+      fprintf(f, ": %s %d,%d,%d", opCodeTab[in->iop], in->iarg1, in->iarg2, in->iarg3);
+    else
+      fprintf(f, ": %s %d,%d(%d)", opCodeTab[in->iop], in->iarg1, in->iarg2, in->iarg3);
+  }
+  fprintf(f, "\n");
+  for (i = 0; i < NO_REGS; i++)
+    fprintf(f, "%1d: %4d%s", i, tm->reg[i], (i % 4 == 3) ? "\n" : "    ");
+} /* tmLimitReport */
+
+/********************************************/
+static STEPRESULT inputTM ( TMContext * tm, int * val )
+{ if ( tm->input != NULL ) return tm->input (tm, val) ;
+  return ioRead (tm, val) ;
+} /* inputTM */
+
+/********************************************/
+static void outputTM ( TMContext * tm, int val )
+{ if ( tm->output != NULL ) tm->output (tm, val) ;
+  else ioWrite (tm, val) ;
+} /* outputTM */
+
+/********************************************/
+static STEPRESULT stepTM ( TMContext * tm )
 { INSTRUCTION currentinstruction  ;
+  int * reg = tm->reg ;
   int pc  ;
   int r,s,t,m  ;
-  int ok ;
 
   pc = reg[PC_REG] ;
-  if ( (pc < 0) || (pc > IADDR_SIZE)  )
+  if ( (pc < 0) || (pc >= tm->iaddrSize)  )
       return srIMEM_ERR ;
   reg[PC_REG] = pc + 1 ;
-  currentinstruction = iMem[ pc ] ;
+  currentinstruction = tm->iMem[ pc ] ;
   switch (opClass(currentinstruction.iop) )
   { case opclRR :
     /***********************************/
@@ -328,7 +679,7 @@ STEPRESULT stepTM (void)
       r = currentinstruction.iarg1 ;
       s = currentinstruction.iarg3 ;
       m = currentinstruction.iarg2 + reg[s] ;
-      if ( (m < 0) || (m > DADDR_SIZE))
+      if ( (m < 0) || (m >= tm->daddrSize))
          return srDMEM_ERR ;
       break;
 
@@ -344,28 +695,15 @@ STEPRESULT stepTM (void)
   { /* RR instructions */
     case opHALT :
     /***********************************/
-      printf("HALT: %1d,%1d,%1d\n",r,s,t);
       return srHALT ;
       /* break; */
 
     case opIN :
     /***********************************/
-      do
-      { printf("Enter value for IN instruction: ") ;
-        fflush (stdin);
-        fflush (stdout);
-        gets(in_Line);
-        lineLen = strlen(in_Line) ;
-        inCol = 0;
-        ok = getNum();
-        if ( ! ok ) printf ("Illegal value\n");
-        else reg[r] = num;
-      }
-      while (! ok);
-      break;
+      return inputTM (tm, &reg[r]) ;
 
-    case opOUT :  
-      printf ("OUT instruction prints: %d\n", reg[r] ) ;
+    case opOUT :
+      outputTM (tm, reg[r]) ;
       break;
     case opADD :  reg[r] = reg[s] + reg[t] ;  break;
     case opSUB :  reg[r] = reg[s] - reg[t] ;  break;
@@ -373,13 +711,14 @@ STEPRESULT stepTM (void)
 
     case opDIV :
     /***********************************/
-      if ( reg[t] != 0 ) reg[r] = reg[s] / reg[t];
-      else return srZERODIVIDE ;
+      if ( reg[t] == 0 ) return srZERODIVIDE ;
+      if ( (reg[s] == INT_MIN) && (reg[t] == -1) ) return srOVERFLOW ;
+      reg[r] = reg[s] / reg[t];
       break;
 
     /*************** RM instructions ********************/
-    case opLD :    reg[r] = dMem[m] ;  break;
-    case opST :    dMem[m] = reg[r] ;  break;
+    case opLD :    reg[r] = tm->dMem[m] ;  break;
+    case opST :    tm->dMem[m] = reg[r] ;  break;
 
     /*************** RA instructions ********************/
     case opLDA :    reg[r] = m ; break;
@@ -397,190 +736,1561 @@ STEPRESULT stepTM (void)
 } /* stepTM */
 
 /********************************************/
-int doCommand (void)
-{ char cmd;
-  int stepcnt=0, i;
-  int printcnt;
-  int stepResult;
-  int regNo, loc;
-  do
-  { printf ("Enter command: ");
-    fflush (stdin);
-    fflush (stdout);
-    gets(in_Line);
-    lineLen = strlen(in_Line);
-    inCol = 0;
-  }
-  while (! getWord ());
-
-  cmd = word[0] ;
-  switch ( cmd )
-  { case 't' :
-    /***********************************/
-      traceflag = ! traceflag ;
-      printf("Tracing now ");
-      if ( traceflag ) printf("on.\n"); else printf("off.\n");
-      break;
+/* fuseTM sets fop of every decoded location */
+/* to the superinstruction that also runs    */
+/* its successor, where there is one. A      */
+/* fault in either half leaves the pc after  */
+/* the faulting instruction, and each half   */
+/* counts as one instruction, so TM-visible  */
+/* behaviour is the same as without fusion.  */
+/********************************************/
+static void fuseTM ( TMContext * tm )
+{ DECODED * code = tm->code;
+  int codeSize = tm->codeSize;
+  int loc, a, b;
+  DECODED * dc;
+  memset(tm->fuseSites, 0, hLim * sizeof(int));
+  for (loc = 0; loc < codeSize; loc++) code[loc].fop = code[loc].op;
+  if ( ! tm->fuse ) return;
+  for (loc = 0; loc + 1 < codeSize; loc++)
+  { dc = &code[loc];
+    /* constant-address forms fuse like the general ones */
+    a = (dc->op == hLDk) ? opLD : (dc->op == hSTk) ? opST : dc->op;
+    b = (dc[1].op == hLDk) ? opLD : (dc[1].op == hSTk) ? opST : dc[1].op;
+    switch ( a )
+    { case opLD :
+        if ( b == opLD ) dc->fop = hLDLD;
+        else if ( b == opST ) dc->fop = hLDST;
+        else if ( b == opADD ) dc->fop = hLDADD;
+        else if ( b == opSUB ) dc->fop = hLDSUB;
+        else if ( b == opMUL ) dc->fop = hLDMUL;
+        break;
+      case opST :
+        if ( b == opLD ) dc->fop = hSTLD;
+        else if ( b == opLDC ) dc->fop = hSTLDC;
+        break;
+      case opLDC :
+        if ( b == opLD ) dc->fop = hLDCLD;
+        else if ( b == opST ) dc->fop = hLDCST;
+        break;
+      case opADD :
+      case opMUL :
+        if ( b == opST ) dc->fop = (a == opADD) ? hADDST : hMULST;
+        break;
+      case opSUB :
+        if ( b == opST ) dc->fop = hSUBST;
+        else if ( (b >= hJLTk) && (b <= hJNEk) ) dc->fop = hSUBJLT + (b - hJLTk);
+        break;
+      case hJLTk : case hJLEk : case hJGTk :
+      case hJGEk : case hJEQk : case hJNEk :
+        if ( (loc + 3 < codeSize) && (dc->d == loc + 3) &&
+             (dc[1].op == opLDC) && (dc[1].d == 0) &&
+             (dc[2].op == hJMPk) && (dc[2].d == loc + 4) &&
+             (dc[3].op == opLDC) && (dc[3].d == 1) && (dc[3].r == dc[1].r) )
+          dc->fop = hBOOLLT + (a - hJLTk);
+        break;
+      default :
+        break;
+    }
+    if ( dc->fop != dc->op ) tm->fuseSites[dc->fop]++;
+  }
+} /* fuseTM */
 
-    case 'h' :
-    /***********************************/
-      printf("Commands are:\n");
-      printf("   s(tep <n>      "\
-             "Execute n (default 1) TM instructions\n");
-      printf("   g(o            "\
-             "Execute TM instructions until HALT\n");
-      printf("   r(egs          "\
-             "Print the contents of the registers\n");
-      printf("   i(Mem <b <n>>  "\
-             "Print n iMem locations starting at b\n");
-      printf("   d(Mem <b <n>>  "\
-             "Print n dMem locations starting at b\n");
-      printf("   t(race         "\
-             "Toggle instruction trace\n");
-      printf("   p(rint         "\
-             "Toggle print of total instructions executed"\
-             " ('go' only)\n");
-      printf("   c(lear         "\
-             "Reset simulator for new execution of program\n");
-      printf("   h(elp          "\
-             "Cause this list of commands to be printed\n");
-      printf("   q(uit          "\
-             "Terminate the simulation\n");
-      break;
+/********************************************/
+/* verifyTM builds the decoded program image */
+/* code[] for runTM. Operands relative to    */
+/* the pc become absolute, constant memory   */
+/* addresses and jump targets proven in      */
+/* range get handlers without run-time       */
+/* checks, and forms runTM has no handler    */
+/* for go through stepTM. A program that can */
+/* fall off the end of iMem is rejected.     */
+/* Only the first codeSize locations are     */
+/* decoded; the rest of iMem is HALT.        */
+/********************************************/
+static int verifyTM ( TMContext * tm )
+{ int codeSize = tm->codeSize;
+  int loc;
+  INSTRUCTION * in;
+  DECODED * dc;
+  for (loc = 0; loc < codeSize; loc++)
+  { in = &tm->iMem[loc];
+    dc = &tm->code[loc];
+    dc->handler = NULL;
+    dc->op = in->iop;
+    dc->r = in->iarg1;
+    if ( (in->iop < opHALT) || (in->iop >= opRALim) ||
+         (in->iarg1 < 0) || (in->iarg1 >= NO_REGS) )
+      return error(tm, "Bad instruction", 0, loc);
+    if ( opClass(in->iop) == opclRR )
+    { dc->s = in->iarg2;
+      dc->t = in->iarg3;
+      dc->d = 0;
+      if ( (dc->s < 0) || (dc->s >= NO_REGS) ||
+           (dc->t < 0) || (dc->t >= NO_REGS) )
+        return error(tm, "Bad register", 0, loc);
+      if ( (in->iop != opHALT) &&
+           ((dc->r == PC_REG) || (dc->s == PC_REG) || (dc->t == PC_REG)) )
+        dc->op = hSTEP;
+    }
+    else
+    { dc->s = in->iarg3;
+      dc->t = 0;
+      dc->d = in->iarg2;
+      if ( (dc->s < 0) || (dc->s >= NO_REGS) )
+        return error(tm, "Bad register", 0, loc);
+      if ( dc->s == PC_REG )
+      { dc->s = ZERO_REG;
+        dc->d += loc + 1;
+      }
+      if ( in->iop == opLDC )
+      { dc->s = ZERO_REG;
+        dc->d = in->iarg2;
+      }
+      if ( dc->r == PC_REG )
+      { switch ( in->iop )
+        { case opLD :  dc->op = hLDpc ;  break;
+          case opLDA :
+          case opLDC : dc->op = hLDApc ; break;
+          default :    dc->op = hSTEP ;  break;
+        }
+      }
+      /* constant operands proven in range */
+      if ( dc->s == ZERO_REG )
+      { if ( (dc->op == opLD) || (dc->op == opST) )
+        { if ( (dc->d >= 0) && (dc->d < tm->daddrSize) )
+            dc->op = (dc->op == opLD) ? hLDk : hSTk;
+        }
+        else if ( (dc->op == hLDApc) || ((dc->op >= opJLT) && (dc->op <= opJNE)) )
+        { if ( (dc->d >= 0) && (dc->d < codeSize) )
+            dc->op = (dc->op == hLDApc) ? hJMPk : hJLTk + (dc->op - opJLT);
+        }
+      }
+    }
+  }
+  /* the last instruction must halt or write the pc */
+  in = &tm->iMem[codeSize-1];
+  if ( (in->iop != opHALT) && ((in->iarg1 != PC_REG) ||
+       (in->iop == opOUT) || (in->iop == opST) || (in->iop >= opJLT)) )
+    return error(tm, "Execution can fall off the end of iMem", 0, codeSize-1);
+  fuseTM (tm);
+  return TRUE;
+} /* verifyTM */
 
-    case 'p' :
-    /***********************************/
-      icountflag = ! icountflag ;
-      printf("Printing instruction count now ");
-      if ( icountflag ) printf("on.\n"); else printf("off.\n");
-      break;
+/********************************************/
+/* runTM executes TM instructions until a    */
+/* result other than srOKAY, dispatching     */
+/* through computed gotos over code[] with   */
+/* the registers and the machine's sizes     */
+/* held in locals. The number of             */
+/* instructions executed is added to steps.  */
+/********************************************/
+static STEPRESULT runTM ( TMContext * tm )
+{ static void * handlerTab[hLim]
+        = { &&lHALT, &&lIN, &&lOUT, &&lADD, &&lSUB, &&lMUL, &&lDIV, &&lSTEP,
+            &&lLD, &&lST, &&lSTEP,
+            &&lLDA, &&lLDC, &&lJLT, &&lJLE, &&lJGT, &&lJGE, &&lJEQ, &&lJNE,
+            &&lSTEP,
+            &&lLDApc, &&lLDpc, &&lSTEP,
+            &&lLDk, &&lSTk, &&lJMPk,
+            &&lJLTk, &&lJLEk, &&lJGTk, &&lJGEk, &&lJEQk, &&lJNEk,
+            &&lLDLD, &&lLDST, &&lSTLD, &&lLDCLD, &&lSTLDC, &&lLDCST,
+            &&lLDADD, &&lLDSUB, &&lLDMUL, &&lADDST, &&lSUBST, &&lMULST,
+            &&lSUBJLT, &&lSUBJLE, &&lSUBJGT, &&lSUBJGE, &&lSUBJEQ, &&lSUBJNE,
+            &&lBOOLLT, &&lBOOLLE, &&lBOOLGT, &&lBOOLGE, &&lBOOLEQ, &&lBOOLNE
+          };
+  DECODED * code = tm->code;
+  int * dMem = tm->dMem;
+  unsigned codeSize = tm->codeSize;
+  unsigned daddrSize = tm->daddrSize;
+  DECODED * ip;
+  int rg[NO_REGS+1];
+  int i, m, pc;
+  long cnt = 0;   /* dispatches */
+  long saved = 0; /* instructions run by superinstructions beyond their first */
+  long check, n;  /* instruction count of the next limit check */
+  STEPRESULT result;
 
-    case 's' :
-    /***********************************/
-      if ( atEOL ())  stepcnt = 1;
-      else if ( getNum ())  stepcnt = abs(num);
-      else   printf("Step count?\n");
-      break;
+#define NEXT         { cnt++; goto *ip->handler; }
+#define TAKE(target) { ip = code + (target); \
+                       if (cnt + saved >= check) goto limits; \
+                       NEXT; }
+#define JUMP(target) { pc = (target); \
+                       if ((unsigned) pc >= codeSize) goto farJump; \
+                       TAKE(pc); }
+#define FAULT(res)   { ip++; result = (res); goto done; }
+/* halves of superinstructions, each leaving ip on the next instruction */
+#define DO_LD        { m = ip->d + rg[ip->s]; \
+                       if ((unsigned) m >= daddrSize) FAULT(srDMEM_ERR); \
+                       rg[ip->r] = dMem[m]; ip++; }
+#define DO_ST        { m = ip->d + rg[ip->s]; \
+                       if ((unsigned) m >= daddrSize) FAULT(srDMEM_ERR); \
+                       dMem[m] = rg[ip->r]; ip++; }
+#define DO_LDC       { rg[ip->r] = ip->d; ip++; }
+#define DO_RR(o)     { rg[ip->r] = rg[ip->s] o rg[ip->t]; ip++; }
+#define SUBJ(c)      { DO_RR(-); saved++; \
+                       if ( rg[ip->r] c 0 ) TAKE(ip->d); \
+                       ip++; NEXT; }
+#define BOOL(c)      { if ( rg[ip->r] c 0 ) { ip += 3; saved++; DO_LDC; } \
+                       else { ip++; saved += 2; DO_LDC; ip = code + ip->d; } \
+                       NEXT; }
 
-    case 'g' :   stepcnt = 1 ;     break;
+  if ( (code[0].handler == NULL) || (tm->handlersFor != tm->breakAt) )
+  { for (i = 0; i < (int) codeSize; i++)
+      code[i].handler = handlerTab[code[i].fop];
+    /* a breakpoint gets a handler of its own, and no
+     * superinstruction may run over it
+     */
+    if ( (tm->breakAt >= 0) && (tm->breakAt < (int) codeSize) )
+    { for (i = tm->breakAt - 3; i < tm->breakAt; i++)
+        if ( i >= 0 ) code[i].handler = handlerTab[code[i].op];
+      code[tm->breakAt].handler = &&lBREAK;
+    }
+    tm->handlersFor = tm->breakAt;
+  }
+  for (i = 0; i < NO_REGS; i++) rg[i] = tm->reg[i];
+  rg[ZERO_REG] = 0;
+  check = limitStart (tm);
+  JUMP(tm->reg[PC_REG]);
 
-    case 'r' :
-    /***********************************/
-      for (i = 0; i < NO_REGS; i++)
-      { printf("%1d: %4d    ", i,reg[i]);
-        if ( (i % 4) == 3 ) printf ("\n");
-      }
-      break;
+lHALT:
+  FAULT(srHALT);
+lIN:
+  if ( tm->breakIn ) goto lBREAK;
+  result = inputTM (tm, &rg[ip->r]);
+  if ( result != srOKAY ) FAULT(result);
+  ip++; NEXT;
+lOUT:
+  outputTM (tm, rg[ip->r]);
+  ip++; NEXT;
+lADD: rg[ip->r] = rg[ip->s] + rg[ip->t]; ip++; NEXT;
+lSUB: rg[ip->r] = rg[ip->s] - rg[ip->t]; ip++; NEXT;
+lMUL: rg[ip->r] = rg[ip->s] * rg[ip->t]; ip++; NEXT;
+lDIV:
+  if ( rg[ip->t] == 0 ) FAULT(srZERODIVIDE);
+  if ( (rg[ip->s] == INT_MIN) && (rg[ip->t] == -1) ) FAULT(srOVERFLOW);
+  rg[ip->r] = rg[ip->s] / rg[ip->t];
+  ip++; NEXT;
+lLD:
+  m = ip->d + rg[ip->s];
+  if ( (unsigned) m >= daddrSize ) FAULT(srDMEM_ERR);
+  rg[ip->r] = dMem[m];
+  ip++; NEXT;
+lST:
+  m = ip->d + rg[ip->s];
+  if ( (unsigned) m >= daddrSize ) FAULT(srDMEM_ERR);
+  dMem[m] = rg[ip->r];
+  ip++; NEXT;
+lLDA: rg[ip->r] = ip->d + rg[ip->s]; ip++; NEXT;
+lLDC: rg[ip->r] = ip->d; ip++; NEXT;
+lJLT: if ( rg[ip->r] <  0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lJLE: if ( rg[ip->r] <= 0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lJGT: if ( rg[ip->r] >  0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lJGE: if ( rg[ip->r] >= 0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lJEQ: if ( rg[ip->r] == 0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lJNE: if ( rg[ip->r] != 0 ) JUMP(ip->d + rg[ip->s]); ip++; NEXT;
+lLDApc: JUMP(ip->d + rg[ip->s]);
+lLDpc:
+  m = ip->d + rg[ip->s];
+  if ( (unsigned) m >= daddrSize ) FAULT(srDMEM_ERR);
+  JUMP(dMem[m]);
+lLDk: rg[ip->r] = dMem[ip->d]; ip++; NEXT;
+lSTk: dMem[ip->d] = rg[ip->r]; ip++; NEXT;
+lJMPk: TAKE(ip->d);
+lJLTk: if ( rg[ip->r] <  0 ) TAKE(ip->d); ip++; NEXT;
+lJLEk: if ( rg[ip->r] <= 0 ) TAKE(ip->d); ip++; NEXT;
+lJGTk: if ( rg[ip->r] >  0 ) TAKE(ip->d); ip++; NEXT;
+lJGEk: if ( rg[ip->r] >= 0 ) TAKE(ip->d); ip++; NEXT;
+lJEQk: if ( rg[ip->r] == 0 ) TAKE(ip->d); ip++; NEXT;
+lJNEk: if ( rg[ip->r] != 0 ) TAKE(ip->d); ip++; NEXT;
+lLDLD:  DO_LD;  saved++; DO_LD;  NEXT;
+lLDST:  DO_LD;  saved++; DO_ST;  NEXT;
+lSTLD:  DO_ST;  saved++; DO_LD;  NEXT;
+lLDCLD: DO_LDC; saved++; DO_LD;  NEXT;
+lSTLDC: DO_ST;  saved++; DO_LDC; NEXT;
+lLDCST: DO_LDC; saved++; DO_ST;  NEXT;
+lLDADD: DO_LD;  saved++; DO_RR(+); NEXT;
+lLDSUB: DO_LD;  saved++; DO_RR(-); NEXT;
+lLDMUL: DO_LD;  saved++; DO_RR(*); NEXT;
+lADDST: DO_RR(+); saved++; DO_ST; NEXT;
+lSUBST: DO_RR(-); saved++; DO_ST; NEXT;
+lMULST: DO_RR(*); saved++; DO_ST; NEXT;
+lSUBJLT: SUBJ(<);
+lSUBJLE: SUBJ(<=);
+lSUBJGT: SUBJ(>);
+lSUBJGE: SUBJ(>=);
+lSUBJEQ: SUBJ(==);
+lSUBJNE: SUBJ(!=);
+lBOOLLT: BOOL(<);
+lBOOLLE: BOOL(<=);
+lBOOLGT: BOOL(>);
+lBOOLGE: BOOL(>=);
+lBOOLEQ: BOOL(==);
+lBOOLNE: BOOL(!=);
+lSTEP:
+  if ( tm->breakIn && (tm->iMem[ip - code].iop == opIN) ) goto lBREAK;
+  for (i = 0; i < NO_REGS; i++) tm->reg[i] = rg[i];
+  tm->reg[PC_REG] = ip - code;
+  result = stepTM (tm);
+  for (i = 0; i < NO_REGS; i++) rg[i] = tm->reg[i];
+  if ( result != srOKAY )
+  { tm->steps += cnt + saved;
+    tm->fuseSaved += saved;
+    return result;
+  }
+  JUMP(tm->reg[PC_REG]);
+lBREAK:
+  /* stop before the instruction at ip, which was not executed */
+  cnt--;
+  result = srBREAK;
+  goto done;
+limits:
+  /* stop before the instruction at ip if a limit is reached */
+  result = limitCheck (tm, cnt + saved, &n);
+  if ( result != srOKAY ) goto done;
+  check = cnt + saved + n;
+  NEXT;
+farJump:
+  /* a HALT past the decoded code, or outside iMem */
+  if ( (pc >= 0) && (pc == tm->breakAt) )
+  { ip = code + pc;
+    result = srBREAK;
+    goto done;
+  }
+  cnt++;
+  for (i = 0; i < NO_REGS; i++) tm->reg[i] = rg[i];
+  tm->reg[PC_REG] = pc;
+  tm->steps += cnt + saved;
+  tm->fuseSaved += saved;
+  return stepTM (tm);
+done:
+  for (i = 0; i < NO_REGS; i++) tm->reg[i] = rg[i];
+  tm->reg[PC_REG] = ip - code;
+  tm->steps += cnt + saved;
+  tm->fuseSaved += saved;
+  return result;
 
-    case 'i' :
-    /***********************************/
-      printcnt = 1 ;
-      if ( getNum ())
-      { iloc = num ;
-        if ( getNum ()) printcnt = num ;
+#undef NEXT
+#undef TAKE
+#undef JUMP
+#undef FAULT
+#undef DO_LD
+#undef DO_ST
+#undef DO_LDC
+#undef DO_RR
+#undef SUBJ
+#undef BOOL
+} /* runTM */
+
+#if defined(__x86_64__)
+/********************************************/
+/* x86-64 JIT: jitCompile translates code[]  */
+/* into machine code in an mmap'd buffer.    */
+/* TM registers 0-6 live in host registers,  */
+/* r15 holds the base of dMem, and jitTab    */
+/* maps every decoded location to its code   */
+/* for indirect jumps. Faults leave the      */
+/* code through exit stubs that store the    */
+/* registers back into reg[]. The code is    */
+/* private to its context; the emitter state */
+/* is per thread.                            */
+/********************************************/
+
+/* host register numbers */
+#define   hRAX  0
+#define   hRCX  1
+#define   hRDX  2
+#define   hRBX  3
+#define   hRSP  4
+#define   hRBP  5
+#define   hRSI  6
+#define   hRDI  7
+#define   hR8   8
+#define   hR9   9
+#define   hR12  12
+#define   hR13  13
+#define   hR14  14
+#define   hR15  15
+
+/* x86 condition codes */
+#define   ccB   0x2
+#define   ccAE  0x3
+#define   ccE   0x4
+#define   ccNE  0x5
+#define   ccL   0xC
+#define   ccGE  0xD
+#define   ccLE  0xE
+#define   ccG   0xF
+
+/* result of an exit that asks for stepTM */
+#define   JIT_STEP  (-1)
+/* fault stub result meaning "already in eax" */
+#define   JIT_EAX   (-2)
+
+/* host registers of TM registers 0-6;
+ * r8 and r9 are caller-saved and are
+ * spilled around calls into the runtime
+ */
+static int hostReg[NO_REGS-1]
+        = { hRBX, hRBP, hR8, hR9, hR12, hR13, hR14 };
+
+/* the context being compiled and its code buffer */
+static __thread TMContext * jitTM;
+static __thread unsigned char * jitBuf;
+static __thread int jitLen;
+
+/* forward jumps patched after all code is emitted:
+ * loc >= 0 is an iMem target, loc < 0 a fault stub
+ * with result res and pc value pcv
+ */
+typedef struct {
+      int site ;
+      int loc ;
+      int res ;
+      int pcv ;
+   } JITFIXUP;
+
+static __thread JITFIXUP * jitFix;
+static __thread int jitNFix;
+static __thread int jitExit, jitFar;
+
+static void jb ( int b ) { jitBuf[jitLen++] = (unsigned char) b; }
+static void jd ( int v ) { memcpy(jitBuf + jitLen, &v, 4); jitLen += 4; }
+static void jq ( long v ) { memcpy(jitBuf + jitLen, &v, 8); jitLen += 8; }
+
+static void jitRex ( int w, int r, int x, int b )
+{ int rex = 0x40 | (w << 3) | ((r >> 3) << 2) | ((x >> 3) << 1) | (b >> 3);
+  if ( rex != 0x40 ) jb(rex);
+}
+
+/* op r/m32, r32 with both operands registers */
+static void jitRR ( int op, int reg, int rm )
+{ jitRex(0, reg, 0, rm);
+  jb(op);
+  jb(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+/* mov dst, src (32 bit) */
+static void jitMov ( int dst, int src )
+{ if ( dst != src ) jitRR(0x89, src, dst); }
+
+/* mov dst, imm32 */
+static void jitMovImm ( int dst, int imm )
+{ jitRex(0, 0, 0, dst);
+  jb(0xB8 + (dst & 7));
+  jd(imm);
+}
+
+/* movabs dst, imm64 */
+static void jitMovAbs ( int dst, void * p )
+{ jitRex(1, 0, 0, dst);
+  jb(0xB8 + (dst & 7));
+  jq((long) p);
+}
+
+/* dst = TM register s + d, where s may be ZERO_REG */
+static void jitAddr ( int dst, int s, int d )
+{ int b;
+  if ( s == ZERO_REG ) { jitMovImm(dst, d); return; }
+  b = hostReg[s];
+  jitRex(0, dst, 0, b);
+  jb(0x8D);                      /* lea dst, [b+disp32] */
+  jb(0x80 | ((dst & 7) << 3) | (b & 7));
+  if ( (b & 7) == hRSP ) jb(0x24);
+  jd(d);
+}
+
+/* op reg, [r15 + idx*4] */
+static void jitMemIdx ( int op, int reg, int idx )
+{ jitRex(0, reg, idx, hR15);
+  jb(op);
+  jb(0x04 | ((reg & 7) << 3));
+  jb(0x80 | ((idx & 7) << 3) | (hR15 & 7));
+}
+
+/* op reg, [r15 + disp32] */
+static void jitMemAbs ( int op, int reg, int disp )
+{ jitRex(0, reg, 0, hR15);
+  jb(op);
+  jb(0x80 | ((reg & 7) << 3) | (hR15 & 7));
+  jd(disp);
+}
+
+/* op r64, [rsp + disp8] */
+static void jitStack ( int w, int op, int reg, int disp )
+{ jitRex(w, reg, 0, hRSP);
+  jb(op);
+  jb(0x44 | ((reg & 7) << 3));
+  jb(0x24);
+  jb(disp);
+}
+
+/* op reg32, [rcx + disp8] for the reg[] array */
+static void jitRegArr ( int op, int reg, int disp )
+{ jitRex(0, reg, 0, hRCX);
+  jb(op);
+  jb(0x40 | ((reg & 7) << 3) | hRCX);
+  jb(disp);
+}
+
+static void jitFixup ( int loc, int res, int pcv )
+{ jitFix[jitNFix].site = jitLen;
+  jitFix[jitNFix].loc = loc;
+  jitFix[jitNFix].res = res;
+  jitFix[jitNFix].pcv = pcv;
+  jitNFix++;
+  jd(0);
+}
+
+static void jitPatch ( int site, int target )
+{ int rel = target - (site + 4);
+  memcpy(jitBuf + site, &rel, 4);
+}
+
+/* jcc rel32 to a fault stub */
+static void jitFault ( int cc, int res, int pcv )
+{ jb(0x0F); jb(0x80 | cc);
+  jitFixup(-1, res, pcv);
+}
+
+/* leave the code with result res and pc pcv */
+static void jitLeave ( int res, int pcv )
+{ jitMovImm(hRAX, res);
+  jitMovImm(hRDX, pcv);
+  jb(0xE9);
+  jitPatch(jitLen, jitExit); jitLen += 4;
+}
+
+/* jump to the iMem location in eax */
+static void jitIndirect ( void )
+{ jb(0x3D); jd(jitTM->codeSize); /* cmp eax, codeSize */
+  jb(0x0F); jb(0x80 | ccAE);
+  jitPatch(jitLen, jitFar); jitLen += 4;
+  jitMovAbs(hRCX, jitTM->jitTab);
+  jb(0xFF); jb(0x24); jb(0xC1);  /* jmp [rcx+rax*8] */
+}
+
+/* save or restore the caller-saved TM registers */
+static void jitSpill ( int save )
+{ jitStack(1, save ? 0x89 : 0x8B, hR8, 8);
+  jitStack(1, save ? 0x89 : 0x8B, hR9, 16);
+}
+
+static void jitCall ( void * fn )
+{ jitMovAbs(hRAX, fn);
+  jb(0xFF); jb(0xD0);            /* call rax */
+}
+
+/* emit the machine code of one decoded instruction */
+static void jitInstruction ( int loc )
+{ DECODED * dc = &jitTM->code[loc];
+  int hr = (dc->r < PC_REG) ? hostReg[dc->r] : hRAX;
+  int site;
+  switch ( dc->op )
+  { case opHALT :
+      jitLeave(srHALT, loc + 1);
+      break;
+    case opIN :
+      jitSpill(TRUE);
+      jitMovAbs(hRDI, jitTM);
+      jitStack(1, 0x8D, hRSI, 0);              /* lea rsi, [rsp] */
+      jitCall((void *) inputTM);
+      jitSpill(FALSE);
+      jitRR(0x85, hRAX, hRAX);                   /* test eax, eax */
+      jitFault(ccNE, JIT_EAX, loc + 1);
+      jitStack(0, 0x8B, hr, 0);                  /* mov hr, [rsp] */
+      break;
+    case opOUT :
+      jitMov(hRSI, hr);
+      jitSpill(TRUE);
+      jitMovAbs(hRDI, jitTM);
+      jitCall((void *) outputTM);
+      jitSpill(FALSE);
+      break;
+    case opADD :
+    case opSUB :
+    case opMUL :
+      jitMov(hRAX, hostReg[dc->s]);
+      if ( dc->op == opMUL )
+      { jitRex(0, hRAX, 0, hostReg[dc->t]);
+        jb(0x0F); jb(0xAF); jb(0xC0 | (hostReg[dc->t] & 7));
       }
-      if ( ! atEOL ())
-        printf ("Instruction locations?\n");
+      else jitRR(dc->op == opADD ? 0x01 : 0x29, hostReg[dc->t], hRAX);
+      jitMov(hr, hRAX);
+      break;
+    case opDIV :
+      jitMov(hRCX, hostReg[dc->t]);
+      jitRR(0x85, hRCX, hRCX);
+      jitFault(ccE, srZERODIVIDE, loc + 1);
+      jitMov(hRAX, hostReg[dc->s]);
+      jb(0x83); jb(0xF9); jb(0xFF);              /* cmp ecx, -1 */
+      jb(0x75); jb(11);                          /* jne over the next two */
+      jb(0x3D); jd(INT_MIN);                     /* cmp eax, INT_MIN */
+      jitFault(ccE, srOVERFLOW, loc + 1);
+      jb(0x99);                                  /* cdq */
+      jb(0xF7); jb(0xF9);                        /* idiv ecx */
+      jitMov(hr, hRAX);
+      break;
+    case opLD :
+    case opST :
+    case hLDpc :
+      jitAddr(hRAX, dc->s, dc->d);
+      jb(0x3D); jd(jitTM->daddrSize);            /* cmp eax, daddrSize */
+      jitFault(ccAE, srDMEM_ERR, loc + 1);
+      if ( dc->op == opST ) jitMemIdx(0x89, hr, hRAX);
+      else if ( dc->op == opLD ) jitMemIdx(0x8B, hr, hRAX);
       else
-      { while ((iloc >= 0) && (iloc < IADDR_SIZE)
-                && (printcnt > 0) )
-        { writeInstruction(iloc);
-          iloc++ ;
-          printcnt-- ;
-        }
+      { jitMemIdx(0x8B, hRAX, hRAX);
+        jitIndirect();
       }
       break;
-
-    case 'd' :
-    /***********************************/
-      printcnt = 1 ;
-      if ( getNum  ())
-      { dloc = num ;
-        if ( getNum ()) printcnt = num ;
+    case hLDk :
+      jitMemAbs(0x8B, hr, dc->d * 4);
+      break;
+    case hSTk :
+      jitMemAbs(0x89, hr, dc->d * 4);
+      break;
+    case opLDA :
+      jitAddr(hr, dc->s, dc->d);
+      break;
+    case opLDC :
+      jitMovImm(hr, dc->d);
+      break;
+    case hLDApc :
+      jitAddr(hRAX, dc->s, dc->d);
+      jitIndirect();
+      break;
+    case hJMPk :
+      jb(0xE9);
+      jitFixup(dc->d, 0, 0);
+      break;
+    case opJLT : case opJLE : case opJGT :
+    case opJGE : case opJEQ : case opJNE :
+    case hJLTk : case hJLEk : case hJGTk :
+    case hJGEk : case hJEQk : case hJNEk :
+    { static int ccTab[] = { ccL, ccLE, ccG, ccGE, ccE, ccNE };
+      int cc = (dc->op >= hJLTk) ? ccTab[dc->op - hJLTk] : ccTab[dc->op - opJLT];
+      jitRR(0x85, hr, hr);                       /* test hr, hr */
+      jb(0x0F);
+      if ( dc->op >= hJLTk )
+      { jb(0x80 | cc);
+        jitFixup(dc->d, 0, 0);
       }
-      if ( ! atEOL ())
-        printf("Data locations?\n");
       else
-      { while ((dloc >= 0) && (dloc < DADDR_SIZE)
-                  && (printcnt > 0))
-        { printf("%5d: %5d\n",dloc,dMem[dloc]);
-          dloc++;
-          printcnt--;
-        }
+      { jb(0x80 | (cc ^ 1));                     /* skip if not taken */
+        site = jitLen; jitLen += 4;
+        jitAddr(hRAX, dc->s, dc->d);
+        jitIndirect();
+        jitPatch(site, jitLen);
       }
       break;
-
-    case 'c' :
-    /***********************************/
-      iloc = 0;
-      dloc = 0;
-      stepcnt = 0;
-      for (regNo = 0;  regNo < NO_REGS ; regNo++)
-            reg[regNo] = 0 ;
-      dMem[0] = DADDR_SIZE - 1 ;
-      for (loc = 1 ; loc < DADDR_SIZE ; loc++)
-            dMem[loc] = 0 ;
+    }
+    default :
+      jitLeave(JIT_STEP, loc);
       break;
+  }
+} /* jitInstruction */
 
-    case 'q' : return FALSE;  /* break; */
-
-    default : printf("Command %c unknown.\n", cmd); break;
-  }  /* case */
-  stepResult = srOKAY;
-  if ( stepcnt > 0 )
-  { if ( cmd == 'g' )
-    { stepcnt = 0;
-      while (stepResult == srOKAY)
-      { iloc = reg[PC_REG] ;
-        if ( traceflag ) writeInstruction( iloc ) ;
-        stepResult = stepTM ();
-        stepcnt++;
-      }
-      if ( icountflag )
-        printf("Number of instructions executed = %d\n",stepcnt);
-    }
+/********************************************/
+static int jitCompile ( TMContext * tm )
+{ int codeSize = tm->codeSize;
+  int jitSize = codeSize * 160 + 4096;
+  int loc, i, stub;
+  jitTM = tm;
+  jitBuf = mmap(NULL, jitSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ( jitBuf == MAP_FAILED ) return FALSE;
+  jitFix = (JITFIXUP *) malloc(2 * codeSize * sizeof(JITFIXUP));
+  tm->jitTab = (void **) malloc(codeSize * sizeof(void *));
+  if ( (jitFix == NULL) || (tm->jitTab == NULL) )
+  { munmap(jitBuf, jitSize);
+    free(jitFix);
+    free(tm->jitTab);
+    tm->jitTab = NULL;
+    return FALSE;
+  }
+  jitNFix = 0;
+  jitLen = 0;
+
+  /* exit stub: eax = result, edx = pc */
+  jitExit = jitLen;
+  jitMovAbs(hRCX, tm->reg);
+  for (i = 0; i < NO_REGS-1; i++) jitRegArr(0x89, hostReg[i], 4*i);
+  jitRegArr(0x89, hRDX, 4*PC_REG);
+  jb(0x48); jb(0x83); jb(0xC4); jb(24);          /* add rsp, 24 */
+  jb(0x41); jb(0x5F); jb(0x41); jb(0x5E);        /* pop r15, r14 */
+  jb(0x41); jb(0x5D); jb(0x41); jb(0x5C);        /* pop r13, r12 */
+  jb(0x5D); jb(0x5B);                            /* pop rbp, rbx */
+  jb(0xC3);
+
+  /* indirect target in eax past the decoded code */
+  jitFar = jitLen;
+  jitMov(hRDX, hRAX);
+  jitMovImm(hRAX, JIT_STEP);
+  jb(0xE9); jitPatch(jitLen, jitExit); jitLen += 4;
+
+  /* entry: int jitEntry(int pc) */
+  tm->jitEntry = (int (*)(int)) (jitBuf + jitLen);
+  jb(0x53); jb(0x55);                            /* push rbx, rbp */
+  jb(0x41); jb(0x54); jb(0x41); jb(0x55);        /* push r12, r13 */
+  jb(0x41); jb(0x56); jb(0x41); jb(0x57);        /* push r14, r15 */
+  jb(0x48); jb(0x83); jb(0xEC); jb(24);          /* sub rsp, 24 */
+  jitMovAbs(hRCX, tm->reg);
+  for (i = 0; i < NO_REGS-1; i++) jitRegArr(0x8B, hostReg[i], 4*i);
+  jitMovAbs(hR15, tm->dMem);
+  jitMov(hRAX, hRDI);
+  jitIndirect();
+
+  for (loc = 0; loc < codeSize; loc++)
+  { tm->jitTab[loc] = jitBuf + jitLen;
+    jitInstruction(loc);
+  }
+
+  /* fault stubs and jumps to iMem locations */
+  for (i = 0; i < jitNFix; i++)
+  { if ( jitFix[i].loc >= 0 )
+      jitPatch(jitFix[i].site, (unsigned char *) tm->jitTab[jitFix[i].loc] - jitBuf);
     else
-    { while ((stepcnt > 0) && (stepResult == srOKAY))
-      { iloc = reg[PC_REG] ;
-        if ( traceflag ) writeInstruction( iloc ) ;
-        stepResult = stepTM ();
-        stepcnt-- ;
+    { stub = jitLen;
+      if ( jitFix[i].res != JIT_EAX ) jitMovImm(hRAX, jitFix[i].res);
+      jitMovImm(hRDX, jitFix[i].pcv);
+      jb(0xE9); jitPatch(jitLen, jitExit); jitLen += 4;
+      jitPatch(jitFix[i].site, stub);
+    }
+  }
+  free(jitFix);
+  if ( mprotect(jitBuf, jitSize, PROT_READ | PROT_EXEC) != 0 )
+  { munmap(jitBuf, jitSize);
+    free(tm->jitTab);
+    tm->jitTab = NULL;
+    tm->jitEntry = NULL;
+    return FALSE;
+  }
+  tm->jitBuf = jitBuf;
+  tm->jitSize = jitSize;
+  return TRUE;
+} /* jitCompile */
+
+/********************************************/
+/* jitRunTM executes TM instructions until a */
+/* result other than srOKAY with the JIT,    */
+/* stepping the rare forms it leaves to      */
+/* stepTM. It falls back to runTM if the     */
+/* code buffer cannot be set up.             */
+/********************************************/
+static STEPRESULT jitRunTM ( TMContext * tm )
+{ int result;
+  if ( (tm->jitEntry == NULL) && ! jitCompile (tm) )
+    return runTM (tm);
+  do
+  { result = tm->jitEntry (tm->reg[PC_REG]);
+    if ( result == JIT_STEP ) result = stepTM (tm);
+  } while ( result == srOKAY );
+  return result;
+} /* jitRunTM */
+#else
+/********************************************/
+static STEPRESULT jitRunTM ( TMContext * tm )
+{ return runTM (tm);
+} /* jitRunTM */
+#endif
+
+
+/********************************************/
+/* profInit builds the per-location table    */
+/* from the line table records: every        */
+/* location belongs to the function with the */
+/* nearest entry at or before it. Programs   */
+/* without records are one function "(tm)".  */
+/* Records with a negative line or locations */
+/* outside the code are rejected.            */
+/********************************************/
+static int profInit ( TMContext * tm )
+{ TMPROF * pr = tm->prof;
+  int codeSize = tm->codeSize;
+  int i, loc, f;
+  for (i = 0; i < pr->nRec; i++)
+    if ( (pr->rec[i].line < 0) || (pr->rec[i].from < 0) ||
+         (pr->rec[i].from > pr->rec[i].to) || (pr->rec[i].to >= codeSize) )
+      return error(tm, "Bad line table record", pr->rec[i].lineNo, -1);
+  pr->loc = (PROFLOC *) calloc(codeSize, sizeof(PROFLOC));
+  for (i = 0; i < pr->nRec; i++)
+    if ( pr->rec[i].name != NULL )
+    { pr->func = (char **) realloc(pr->func, (pr->nFunc+1) * sizeof(char *));
+      pr->entry = (int *) realloc(pr->entry, (pr->nFunc+1) * sizeof(int));
+      pr->func[pr->nFunc] = pr->rec[i].name;
+      pr->entry[pr->nFunc++] = pr->rec[i].from;
+    }
+  if ( pr->nFunc == 0 )
+  { pr->func = (char **) malloc(sizeof(char *));
+    pr->entry = (int *) malloc(sizeof(int));
+    pr->func[0] = "(tm)";
+    pr->entry[0] = 0;
+    pr->nFunc = 1;
+  }
+  for (loc = 0; loc < codeSize; loc++) pr->loc[loc].func = -1;
+  for (f = 0; f < pr->nFunc; f++)
+    pr->loc[pr->entry[f]].func = f;
+  f = 0;
+  for (loc = 0; loc < codeSize; loc++)
+  { if ( pr->loc[loc].func >= 0 ) f = pr->loc[loc].func;
+    else pr->loc[loc].func = f;
+  }
+  for (i = 0; i < pr->nRec; i++)
+    if ( pr->rec[i].name == NULL )
+      for (loc = pr->rec[i].from; loc <= pr->rec[i].to; loc++)
+        pr->loc[loc].line = pr->rec[i].line;
+  pr->root = (CALLNODE *) calloc(1, sizeof(CALLNODE));
+  pr->root->func = pr->loc[0].func;
+  pr->cur = pr->root;
+  pr->depth = 0;
+  return TRUE;
+} /* profInit */
+
+/* free the call tree below n */
+static void profFreeTree ( CALLNODE * n )
+{ CALLNODE * c, * next;
+  if ( n == NULL ) return;
+  for (c = n->child; c != NULL; c = next)
+  { next = c->sibling;
+    profFreeTree(c);
+  }
+  free(n);
+}
+
+/********************************************/
+static void profFree ( TMContext * tm )
+{ TMPROF * pr = tm->prof;
+  int i;
+  if ( pr == NULL ) return;
+  for (i = 0; i < pr->nRec; i++) free(pr->rec[i].name);
+  free(pr->rec);
+  free(pr->loc);
+  free(pr->func);
+  free(pr->entry);
+  profFreeTree(pr->root);
+  free(pr->stkNode);
+  free(pr->stkRet);
+  free(pr);
+  tm->prof = NULL;
+} /* profFree */
+
+/********************************************/
+/* profCall enters function func, to return  */
+/* to location ret, in the call tree.        */
+/********************************************/
+static void profCall ( TMPROF * pr, int func, int ret )
+{ CALLNODE * c;
+  if ( pr->depth >= pr->stkSize )
+  { pr->stkSize = 2 * pr->stkSize + 64;
+    pr->stkNode = (CALLNODE **) realloc(pr->stkNode, pr->stkSize * sizeof(CALLNODE *));
+    pr->stkRet = (int *) realloc(pr->stkRet, pr->stkSize * sizeof(int));
+  }
+  pr->stkNode[pr->depth] = pr->cur;
+  pr->stkRet[pr->depth++] = ret;
+  for (c = pr->cur->child; c != NULL; c = c->sibling)
+    if ( c->func == func ) break;
+  if ( c == NULL )
+  { c = (CALLNODE *) calloc(1, sizeof(CALLNODE));
+    c->func = func;
+    c->parent = pr->cur;
+    c->sibling = pr->cur->child;
+    pr->cur->child = c;
+  }
+  pr->cur = c;
+} /* profCall */
+
+/********************************************/
+/* profStep counts the execution of the      */
+/* instruction at pc, which gave result, and */
+/* its branch if taken. A jump to a function */
+/* entry is a call; a register jump to the   */
+/* innermost return location is its return.  */
+/********************************************/
+static void profStep ( TMContext * tm, int pc, STEPRESULT result )
+{ TMPROF * pr = tm->prof;
+  INSTRUCTION * in;
+  PROFLOC * p;
+  int npc;
+  if ( (pc < 0) || (pc >= tm->codeSize) ) return;
+  p = &pr->loc[pc];
+  p->count++;
+  pr->cur->self++;
+  npc = tm->reg[PC_REG];
+  if ( (result != srOKAY) || (npc == pc + 1) ) return;
+  in = &tm->iMem[pc];
+  if ( in->iop >= opJLT ) p->taken++;
+  if ( (npc >= 0) && (npc < tm->codeSize) && (pr->entry[pr->loc[npc].func] == npc) )
+    profCall(pr, pr->loc[npc].func, pc + 1);
+  else if ( (pr->depth > 0) && (npc == pr->stkRet[pr->depth-1]) &&
+            (in->iarg1 == PC_REG) && (in->iarg3 != PC_REG) )
+    pr->cur = pr->stkNode[--pr->depth];
+} /* profStep */
+
+/* sort keys for profSort */
+static __thread long * profKey;
+
+static int profCmp ( const void * a, const void * b )
+{ long ka = profKey[*(const int *) a], kb = profKey[*(const int *) b];
+  if ( ka != kb ) return (ka < kb) ? 1 : -1;
+  return *(const int *) a - *(const int *) b;
+}
+
+/* fill idx with 0..n-1 ordered by descending key */
+static void profSort ( int * idx, long * key, int n )
+{ int i;
+  for (i = 0; i < n; i++) idx[i] = i;
+  profKey = key;
+  qsort(idx, n, sizeof(int), profCmp);
+}
+
+/* stack of call tree nodes on the way to the node being walked */
+static __thread CALLNODE ** profPath = NULL;
+static __thread int profPathSize = 0;
+
+/********************************************/
+/* profWalk writes the collapsed stacks of   */
+/* the call tree below n, at depth, to f and */
+/* adds the inclusive counts of functions not*/
+/* already on the path to incl. It returns   */
+/* the instructions executed below n.        */
+/********************************************/
+static long profWalk ( TMPROF * pr, CALLNODE * n, int depth, long * incl,
+                       int * onPath, FILE * f )
+{ CALLNODE * c;
+  long total = n->self;
+  int i;
+  if ( depth >= profPathSize )
+  { profPathSize = 2 * profPathSize + 64;
+    profPath = (CALLNODE **) realloc(profPath, profPathSize * sizeof(CALLNODE *));
+  }
+  profPath[depth] = n;
+  if ( n->self > 0 )
+  { for (i = 0; i <= depth; i++)
+      fprintf(f, "%s%s", (i > 0) ? ";" : "", pr->func[profPath[i]->func]);
+    fprintf(f, " %ld\n", n->self);
+  }
+  onPath[n->func]++;
+  for (c = n->child; c != NULL; c = c->sibling)
+    total += profWalk(pr, c, depth + 1, incl, onPath, f);
+  if ( --onPath[n->func] == 0 ) incl[n->func] += total;
+  return total;
+} /* profWalk */
+
+/********************************************/
+/* tmProfileReport writes the hot spot       */
+/* report to file name, functions, source    */
+/* lines and instructions each sorted by     */
+/* count, and the collapsed stacks           */
+/* ("_start;main;f n" lines, as flamegraph   */
+/* tools read them) to name.folded. Returns  */
+/* FALSE with the reason in errMsg if the    */
+/* machine was not profiled or a file cannot */
+/* be written.                               */
+/********************************************/
+int tmProfileReport ( TMContext * tm, char * name )
+{ TMPROF * pr = tm->prof;
+  int codeSize = tm->codeSize;
+  FILE * f;
+  char * foldName;
+  long * incl, * self, * lineCnt, * locCnt;
+  int * onPath, * lineFunc, * idx;
+  long total = 0;
+  double scale;
+  long * locLine;
+  int * lineNo;
+  int i, j, loc, nLines = 0;
+  INSTRUCTION * in;
+
+  if ( pr == NULL )
+  { sprintf(tm->errMsg, "no profile was collected");
+    return FALSE;
+  }
+  foldName = (char *) malloc(strlen(name) + 8);
+  sprintf(foldName, "%s.folded", name);
+  f = fopen(foldName, "w");
+  if ( f == NULL )
+  { snprintf(tm->errMsg, sizeof(tm->errMsg), "cannot write %s", foldName);
+    free(foldName);
+    return FALSE;
+  }
+  free(foldName);
+  incl = (long *) calloc(pr->nFunc, sizeof(long));
+  self = (long *) calloc(pr->nFunc, sizeof(long));
+  onPath = (int *) calloc(pr->nFunc, sizeof(int));
+  profWalk(pr, pr->root, 0, incl, onPath, f);
+  fclose(f);
+
+  locCnt = (long *) malloc(codeSize * sizeof(long));
+  locLine = (long *) malloc(codeSize * sizeof(long));
+  for (loc = 0; loc < codeSize; loc++)
+  { locCnt[loc] = pr->loc[loc].count;
+    locLine[loc] = pr->loc[loc].line;
+    total += locCnt[loc];
+    self[pr->loc[loc].func] += locCnt[loc];
+  }
+  scale = (total > 0) ? 100.0 / total : 0.0;
+  idx = (int *) malloc((pr->nFunc + codeSize + 1) * sizeof(int));
+
+  /* one entry per source line with code, in
+   * ascending order; a line belongs to the
+   * function of its first location
+   */
+  lineCnt = (long *) malloc((codeSize + 1) * sizeof(long));
+  lineNo = (int *) malloc((codeSize + 1) * sizeof(int));
+  lineFunc = (int *) malloc((codeSize + 1) * sizeof(int));
+  profSort(idx, locLine, codeSize);
+  for (i = codeSize - 1; i >= 0; i--)
+  { loc = idx[i];
+    if ( pr->loc[loc].line == 0 ) continue;
+    if ( (nLines == 0) || (lineNo[nLines-1] != pr->loc[loc].line) )
+    { lineNo[nLines] = pr->loc[loc].line;
+      lineCnt[nLines++] = 0;
+    }
+    lineCnt[nLines-1] += locCnt[loc];
+    lineFunc[nLines-1] = pr->loc[loc].func;
+  }
+
+  f = fopen(name, "w");
+  if ( f == NULL )
+    snprintf(tm->errMsg, sizeof(tm->errMsg), "cannot write %s", name);
+  else
+  { fprintf(f, "TM profile of %s\n", tm->name);
+    fprintf(f, "%ld instructions executed\n", total);
+
+    fprintf(f, "\nFunctions by inclusive count:\n");
+    fprintf(f, "%14s %6s %14s %6s  %s\n", "inclusive", "%", "self", "%", "function");
+    profSort(idx, incl, pr->nFunc);
+    for (i = 0; i < pr->nFunc; i++)
+    { j = idx[i];
+      if ( (incl[j] == 0) && (self[j] == 0) ) continue;
+      fprintf(f, "%14ld %6.2f %14ld %6.2f  %s\n", incl[j], incl[j] * scale,
+              self[j], self[j] * scale, pr->func[j]);
+    }
+
+    if ( nLines > 0 )
+    { fprintf(f, "\nSource lines by count:\n");
+      fprintf(f, "%14s %6s %6s  %s\n", "count", "%", "line", "function");
+      profSort(idx, lineCnt, nLines);
+      for (i = 0; i < nLines; i++)
+      { j = idx[i];
+        if ( lineCnt[j] == 0 ) continue;
+        fprintf(f, "%14ld %6.2f %6d  %s\n", lineCnt[j], lineCnt[j] * scale,
+                lineNo[j], pr->func[lineFunc[j]]);
       }
     }
-    printf( "%s\n",stepResultTab[stepResult] );
+
+    fprintf(f, "\nInstructions by count:\n");
+    fprintf(f, "%14s %6s %5s %6s  %-18s %14s %14s\n",
+            "count", "%", "loc", "line", "instruction", "taken", "not taken");
+    profSort(idx, locCnt, codeSize);
+    for (i = 0; i < codeSize; i++)
+    { char text[LINESIZE];
+      loc = idx[i];
+      if ( locCnt[loc] == 0 ) break;
+      in = &tm->iMem[loc];
+      if ( opClass(in->iop) == opclRR )
+        sprintf(text, "%-5s %d,%d,%d", opCodeTab[in->iop], in->iarg1, in->iarg2, in->iarg3);
+      else
+        sprintf(text, "%-5s %d,%d(%d)", opCodeTab[in->iop], in->iarg1, in->iarg2, in->iarg3);
+      fprintf(f, "%14ld %6.2f %5d %6d  ", locCnt[loc], locCnt[loc] * scale,
+              loc, pr->loc[loc].line);
+      if ( in->iop >= opJLT )
+        fprintf(f, "%-18s %14ld %14ld\n", text,
+                pr->loc[loc].taken, locCnt[loc] - pr->loc[loc].taken);
+      else fprintf(f, "%s\n", text);
+    }
+    fclose(f);
+  }
+  free(incl); free(self); free(onPath);
+  free(locCnt); free(locLine); free(lineCnt); free(lineNo); free(lineFunc);
+  free(idx);
+  return f != NULL;
+} /* tmProfileReport */
+
+/********************************************/
+/* tmFuseReport prints the fusion            */
+/* statistics: the sites of every            */
+/* superinstruction and the dispatches runTM */
+/* saved through them.                       */
+/********************************************/
+void tmFuseReport ( TMContext * tm, FILE * f )
+{ int h, sites = 0;
+  for (h = hLDLD; h < hLim; h++)
+    if ( tm->fuseSites[h] > 0 )
+    { fprintf(f, "%6d  %s\n", tm->fuseSites[h], fuseNameTab[h - hLDLD]);
+      sites += tm->fuseSites[h];
+    }
+  fprintf(f, "%6d  superinstruction sites in %d locations%s\n", sites, tm->codeSize,
+          tm->fuse ? "" : " (fusion off)");
+  fprintf(f, "Dispatches saved by fusion = %ld\n", tm->fuseSaved);
+} /* tmFuseReport */
+
+/******** step history ********/
+
+/* what one instruction changed: besides the pc, an
+ * instruction writes at most one register or one
+ * dMem location
+ */
+typedef struct {
+      int pc, next ;   /* location, and the pc after it */
+      int r ;          /* register written, -1 for none */
+      int rOld, rNew ;
+      int addr ;       /* dMem location written, -1 for none */
+      int mOld, mNew ;
+      STEPRESULT result ;
+   } HISTREC;
+
+/* ring of the last size steps */
+typedef struct tmhist {
+      HISTREC * rec ;
+      int size ;
+      int head ;    /* next record to write */
+      int count ;   /* records held, up to size */
+   } TMHIST;
+
+/********************************************/
+static void histFree ( TMContext * tm )
+{ if ( tm->hist == NULL ) return;
+  free(tm->hist->rec);
+  free(tm->hist);
+  tm->hist = NULL;
+} /* histFree */
+
+/********************************************/
+/* histBefore starts the record of the       */
+/* instruction at the pc: the register or    */
+/* dMem location it may write and the value  */
+/* there now.                                */
+/********************************************/
+static HISTREC * histBefore ( TMContext * tm )
+{ TMHIST * h = tm->hist;
+  HISTREC * rec = &h->rec[h->head];
+  int pc = tm->reg[PC_REG];
+  INSTRUCTION * in;
+  int m;
+  if ( ++h->head == h->size ) h->head = 0;
+  if ( h->count < h->size ) h->count++;
+  rec->pc = pc;
+  rec->r = rec->addr = -1;
+  if ( (pc < 0) || (pc >= tm->iaddrSize) ) return rec;
+  in = &tm->iMem[pc];
+  switch ( in->iop )
+  { case opIN : case opADD : case opSUB : case opMUL : case opDIV :
+    case opLD : case opLDA : case opLDC :
+      rec->r = in->iarg1;
+      rec->rOld = tm->reg[rec->r];
+      break;
+    case opST :
+      m = in->iarg2 + tm->reg[in->iarg3];
+      if ( (m >= 0) && (m < tm->daddrSize) )
+      { rec->addr = m;
+        rec->mOld = tm->dMem[m];
+      }
+      break;
   }
+  return rec;
+} /* histBefore */
+
+/********************************************/
+static void histAfter ( TMContext * tm, HISTREC * rec, STEPRESULT result )
+{ rec->next = tm->reg[PC_REG];
+  rec->result = result;
+  if ( (result != srOKAY) && (result != srHALT) )
+    rec->r = rec->addr = -1;  /* faulted before writing */
+  if ( rec->r >= 0 ) rec->rNew = tm->reg[rec->r];
+  if ( rec->addr >= 0 ) rec->mNew = tm->dMem[rec->addr];
+} /* histAfter */
+
+/********************************************/
+/* tmStepBack undoes the last step recorded  */
+/* in the history.                           */
+/********************************************/
+int tmStepBack ( TMContext * tm )
+{ TMHIST * h = tm->hist;
+  HISTREC * rec;
+  if ( (h == NULL) || (h->count == 0) ) return FALSE;
+  if ( --h->head < 0 ) h->head = h->size - 1;
+  h->count--;
+  rec = &h->rec[h->head];
+  if ( rec->r >= 0 ) tm->reg[rec->r] = rec->rOld;
+  if ( rec->addr >= 0 ) tm->dMem[rec->addr] = rec->mOld;
+  tm->reg[PC_REG] = rec->pc;
   return TRUE;
-} /* doCommand */
+} /* tmStepBack */
+
+/********************************************/
+/* tmHistoryReport prints the last n steps   */
+/* of the history, oldest first, with what   */
+/* each one changed.                         */
+/********************************************/
+void tmHistoryReport ( TMContext * tm, FILE * f, int n )
+{ TMHIST * h = tm->hist;
+  HISTREC * rec;
+  int i;
+  if ( h == NULL ) return;
+  if ( n > h->count ) n = h->count;
+  for (i = n; i > 0; i--)
+  { rec = &h->rec[(h->head - i + h->size) % h->size];
+    fprintf(f, "%6d ", -i);
+    writeInstruction (tm, f, rec->pc);
+    if ( (rec->r >= 0) && (rec->r != PC_REG) )
+      fprintf(f, "   r%d: %d -> %d", rec->r, rec->rOld, rec->rNew);
+    if ( rec->addr >= 0 )
+      fprintf(f, "   dMem[%d]: %d -> %d", rec->addr, rec->mOld, rec->mNew);
+    if ( rec->next != rec->pc + 1 ) fprintf(f, "   pc -> %d", rec->next);
+    if ( rec->result != srOKAY ) fprintf(f, "   (%s)", stepResultTab[rec->result]);
+    fprintf(f, "\n");
+  }
+} /* tmHistoryReport */
 
+/******** contexts ********/
 
 /********************************************/
-/* E X E C U T I O N   B E G I N S   H E R E */
+/* tmCreate maps iMem, code[] and dMem for   */
+/* the given sizes. Nothing is touched       */
+/* here, so untouched memory costs no time   */
+/* or physical pages however large it is.    */
 /********************************************/
+TMContext * tmCreate ( int iaddrSize, int daddrSize )
+{ size_t page = sysconf(_SC_PAGESIZE);
+  size_t ilen, dlen;
+  TMContext * tm;
+  char * base;
+  if ( (iaddrSize <= 0) || (iaddrSize > ADDR_MAX) ||
+       (daddrSize <= 0) || (daddrSize > ADDR_MAX) )
+    return NULL;
+  tm = (TMContext *) calloc(1, sizeof(TMContext));
+  if ( tm == NULL ) return NULL;
+  ilen = (size_t) iaddrSize * (sizeof(INSTRUCTION) + sizeof(DECODED));
+  ilen = (ilen + page - 1) / page * page;
+  dlen = (size_t) daddrSize * sizeof(int);
+  dlen = (dlen + page - 1) / page * page;
+  base = mmap(NULL, ilen + dlen, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  tm->fuseSites = (int *) calloc(hLim, sizeof(int));
+  tm->outBuf = (char *) malloc(IOBUFSIZE);
+  if ( (base == MAP_FAILED) || (tm->fuseSites == NULL) || (tm->outBuf == NULL) )
+  { if ( base != MAP_FAILED ) munmap(base, ilen + dlen);
+    free(tm->fuseSites);
+    free(tm->outBuf);
+    free(tm);
+    return NULL;
+  }
+  tm->mem = base;
+  tm->memLen = ilen + dlen;
+  tm->code = (DECODED *) base;
+  tm->iMem = (INSTRUCTION *) (base + (size_t) iaddrSize * sizeof(DECODED));
+  tm->dMem = (int *) (base + ilen);
+  tm->iaddrSize = iaddrSize;
+  tm->daddrSize = daddrSize;
+  tm->fuse = TRUE;
+  tm->breakAt = -1;
+  tm->handlersFor = -1;
+  tm->outFd = 1;
+  tm->outSize = IOBUFSIZE;
+  return tm;
+} /* tmCreate */
 
-main( int argc, char * argv[] )
-{ if (argc != 2)
-  { printf("usage: %s <filename>\n",argv[0]);
-    exit(1);
+/********************************************/
+void tmDestroy ( TMContext * tm )
+{ if ( tm == NULL ) return;
+  tmFlush (tm);
+  ioClose (tm);
+  if ( tm->jitBuf != NULL ) munmap(tm->jitBuf, tm->jitSize);
+  free(tm->jitTab);
+  profFree (tm);
+  histFree (tm);
+  munmap(tm->mem, tm->memLen);
+  free(tm->fuseSites);
+  free(tm->outBuf);
+  free(tm);
+} /* tmDestroy */
+
+/********************************************/
+/* tmLoad reads the program, verifies and    */
+/* decodes it, and sets up the profile and  */
+/* the step history when asked for. A        */
+/* program loaded before is replaced.        */
+/********************************************/
+int tmLoad ( TMContext * tm, FILE * pgm )
+{ memset(tm->iMem, 0, tm->codeSize * sizeof(INSTRUCTION));
+  if ( tm->jitBuf != NULL ) munmap(tm->jitBuf, tm->jitSize);
+  free(tm->jitTab);
+  tm->jitBuf = NULL;
+  tm->jitTab = NULL;
+  tm->jitEntry = NULL;
+  tm->fuseSaved = 0;
+  profFree (tm);
+  if ( tm->profile )
+    tm->prof = (TMPROF *) calloc(1, sizeof(TMPROF));
+  if ( ! readInstructions (tm, pgm) || ! verifyTM (tm) ||
+       ((tm->prof != NULL) && ! profInit (tm)) )
+  { profFree (tm);
+    return FALSE;
   }
-  strcpy(pgmName,argv[1]) ;
-  if (strchr (pgmName, '.') == NULL)
-     strcat(pgmName,".tm");
-  pgm = fopen(pgmName,"r");
-  if (pgm == NULL)
-  { printf("file '%s' not found\n",pgmName);
-    exit(1);
+  histFree (tm);
+  if ( tm->history > 0 )
+  { tm->hist = (TMHIST *) calloc(1, sizeof(TMHIST));
+    tm->hist->rec = (HISTREC *) malloc(tm->history * sizeof(HISTREC));
+    tm->hist->size = tm->history;
   }
+  return TRUE;
+} /* tmLoad */
 
-  /* read the program */
-  if ( ! readInstructions ())
-         exit(1) ;
-  /* switch input file to terminal */
-  /* reset( input ); */
-  /* read-eval-print */
-  printf("TM  simulation (enter h for help)...\n");
+/********************************************/
+int tmLoadFile ( TMContext * tm, char * name )
+{ FILE * pgm = fopen(name, "r");
+  int ok;
+  if ( pgm == NULL )
+  { snprintf(tm->errMsg, sizeof(tm->errMsg), "file '%s' not found", name);
+    return FALSE;
+  }
+  strncpy(tm->name, name, sizeof(tm->name)-1);
+  ok = tmLoad (tm, pgm);
+  fclose(pgm);
+  return ok;
+} /* tmLoadFile */
+
+/********************************************/
+void tmReset ( TMContext * tm )
+{ int regNo;
+  for (regNo = 0;  regNo < NO_REGS ; regNo++)
+        tm->reg[regNo] = 0 ;
+  clearDMem (tm);
+  if ( tm->prof != NULL )
+  { tm->prof->cur = tm->prof->root;
+    tm->prof->depth = 0;
+  }
+  if ( tm->hist != NULL ) tm->hist->count = 0;
+} /* tmReset */
+
+/******** snapshots ********/
+
+struct tmsnapshot {
+      int reg [NO_REGS] ;
+      int daddrSize ;
+      size_t pageSize ;
+      int nPages ;
+      int * pageNo ;   /* dMem page of every saved page */
+      char * data ;    /* nPages pages */
+   };
+
+/********************************************/
+/* mappedPages sets vec[i] to 1 for every    */
+/* page of dMem the system has mapped, in    */
+/* memory or in swap, from the present and   */
+/* swapped bits of /proc/self/pagemap. Pages */
+/* never touched, or given back by           */
+/* clearDMem, are not mapped. Without the    */
+/* pagemap every page counts as mapped.      */
+/********************************************/
+static void mappedPages ( TMContext * tm, size_t page, size_t n,
+                          unsigned char * vec )
+{ unsigned long long e [512];
+  off_t start = (off_t) ((size_t) tm->dMem / page) * sizeof(e[0]);
+  size_t i, j, k;
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  memset(vec, 1, n);
+  if ( fd < 0 ) return;
+  for (i = 0; i < n; i += k)
+  { k = (n - i < 512) ? n - i : 512;
+    if ( pread(fd, e, k * sizeof(e[0]), start + i * sizeof(e[0]))
+         != (ssize_t) (k * sizeof(e[0])) )
+    { memset(vec, 1, n);
+      break;
+    }
+    for (j = 0; j < k; j++)
+      vec[i + j] = (e[j] >> 62) != 0;
+  }
+  close(fd);
+} /* mappedPages */
+
+/********************************************/
+/* tmSnapshot saves the registers and the    */
+/* dMem pages that are mapped and not all    */
+/* zero, so the cost follows the memory the  */
+/* program has used rather than the size of  */
+/* dMem.                                     */
+/********************************************/
+TMSnapshot * tmSnapshot ( TMContext * tm )
+{ size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = dMemLen(tm, page), n = len / page, i, w;
+  unsigned char * vec = (unsigned char *) malloc(n);
+  TMSnapshot * snap = (TMSnapshot *) calloc(1, sizeof(TMSnapshot));
+  int size = 0;
+  int * pageNo;
+  char * data;
+  char * p;
+  long * q;
+  if ( (vec == NULL) || (snap == NULL) )
+  { free(vec);
+    free(snap);
+    return NULL;
+  }
+  memcpy(snap->reg, tm->reg, sizeof(snap->reg));
+  snap->daddrSize = tm->daddrSize;
+  snap->pageSize = page;
+  mappedPages(tm, page, n, vec);
+  for (i = 0; i < n; i++)
+  { if ( vec[i] == 0 ) continue;
+    p = (char *) tm->dMem + i * page;
+    q = (long *) p;
+    for (w = 0; w < page / sizeof(long); w++)
+      if ( q[w] != 0 ) break;
+    if ( w == page / sizeof(long) ) continue;
+    if ( snap->nPages >= size )
+    { size = 2 * size + 16;
+      pageNo = (int *) realloc(snap->pageNo, size * sizeof(int));
+      if ( pageNo != NULL ) snap->pageNo = pageNo;
+      data = (char *) realloc(snap->data, size * page);
+      if ( data != NULL ) snap->data = data;
+      if ( (pageNo == NULL) || (data == NULL) )
+      { free(vec);
+        tmFreeSnapshot (snap);
+        return NULL;
+      }
+    }
+    snap->pageNo[snap->nPages] = i;
+    memcpy(snap->data + snap->nPages * page, p, page);
+    snap->nPages++;
+  }
+  free(vec);
+  return snap;
+} /* tmSnapshot */
+
+/********************************************/
+int tmRestore ( TMContext * tm, TMSnapshot * snap )
+{ int i;
+  if ( snap->daddrSize != tm->daddrSize ) return FALSE;
+  zeroDMem (tm);
+  for (i = 0; i < snap->nPages; i++)
+    memcpy((char *) tm->dMem + snap->pageNo[i] * snap->pageSize,
+           snap->data + i * snap->pageSize, snap->pageSize);
+  memcpy(tm->reg, snap->reg, sizeof(tm->reg));
+  if ( tm->prof != NULL )
+  { tm->prof->cur = tm->prof->root;
+    tm->prof->depth = 0;
+  }
+  if ( tm->hist != NULL ) tm->hist->count = 0;
+  return TRUE;
+} /* tmRestore */
+
+/********************************************/
+int tmSnapshotPages ( TMSnapshot * snap )
+{ return snap->nPages;
+} /* tmSnapshotPages */
+
+/********************************************/
+void tmFreeSnapshot ( TMSnapshot * snap )
+{ if ( snap == NULL ) return;
+  free(snap->pageNo);
+  free(snap->data);
+  free(snap);
+} /* tmFreeSnapshot */
+
+/********************************************/
+/* tmClone returns a new machine with the    */
+/* decoded program, options, hooks and state */
+/* of tm, or NULL. It keeps no profile or    */
+/* step history and starts with the default  */
+/* batch I/O.                                */
+/********************************************/
+TMContext * tmClone ( TMContext * tm )
+{ TMContext * c = tmCreate (tm->iaddrSize, tm->daddrSize);
+  TMSnapshot * snap;
+  if ( c == NULL ) return NULL;
+  snap = tmSnapshot (tm);
+  if ( snap == NULL )
+  { tmDestroy (c);
+    return NULL;
+  }
+  memcpy(c->iMem, tm->iMem, tm->codeSize * sizeof(INSTRUCTION));
+  memcpy(c->code, tm->code, tm->codeSize * sizeof(DECODED));
+  memcpy(c->fuseSites, tm->fuseSites, hLim * sizeof(int));
+  c->codeSize = tm->codeSize;
+  c->handlersFor = tm->handlersFor;
+  c->jit = tm->jit;
+  c->fuse = tm->fuse;
+  c->binary = tm->binary;
+  c->fuelLimit = tm->fuelLimit;
+  c->timeLimit = tm->timeLimit;
+  c->breakAt = tm->breakAt;
+  c->breakIn = tm->breakIn;
+  c->input = tm->input;
+  c->output = tm->output;
+  c->trace = tm->trace;
+  c->user = tm->user;
+  strcpy(c->name, tm->name);
+  tmRestore (c, snap);
+  tmFreeSnapshot (snap);
+  return c;
+} /* tmClone */
+
+/********************************************/
+/* tmStep executes one instruction through   */
+/* stepTM, traced, profiled and recorded in  */
+/* the history when asked.                   */
+/********************************************/
+STEPRESULT tmStep ( TMContext * tm )
+{ int pc = tm->reg[PC_REG];
+  STEPRESULT result;
+  HISTREC * rec = NULL;
+  if ( tm->trace != NULL ) tm->trace (tm, pc);
+  if ( tm->hist != NULL ) rec = histBefore (tm);
+  result = stepTM (tm);
+  if ( rec != NULL ) histAfter (tm, rec, result);
+  if ( tm->prof != NULL ) profStep (tm, pc, result);
+  return result;
+} /* tmStep */
+
+/********************************************/
+/* stepRunTM executes TM instructions until  */
+/* a result other than srOKAY one at a time  */
+/* through tmStep, for tracing, profiling    */
+/* and the step history. The other run loops */
+/* carry none of this, so it costs nothing   */
+/* when off.                                 */
+/********************************************/
+static STEPRESULT stepRunTM ( TMContext * tm )
+{ STEPRESULT result;
+  long check = limitStart (tm), n;
   do
-     done = ! doCommand ();
-  while (! done );
-  printf("Simulation done.\n");
-  return 0;
-}
+  { if ( tm->steps >= check )
+    { result = limitCheck (tm, tm->steps, &n);
+      if ( result != srOKAY ) return result;
+      check = tm->steps + n;
+    }
+    if ( atBreak (tm) ) return srBREAK;
+    result = tmStep (tm);
+    tm->steps++;
+  } while ( result == srOKAY );
+  return result;
+} /* stepRunTM */
+
+/********************************************/
+/* tmRun picks the run loop: stepping for a  */
+/* trace, profile or history, the JIT when   */
+/* nobody needs the count, limits or breaks, */
+/* else runTM. A run starting at a break     */
+/* first steps over it.                      */
+/********************************************/
+STEPRESULT tmRun ( TMContext * tm, long * stepcnt )
+{ STEPRESULT result = srOKAY;
+  tm->steps = 0;
+  if ( atBreak (tm) )
+  { result = tmStep (tm);
+    tm->steps++;
+  }
+  if ( result == srOKAY )
+  { if ( (tm->trace != NULL) || (tm->prof != NULL) || (tm->hist != NULL) )
+      result = stepRunTM (tm);
+    else if ( tm->jit && (stepcnt == NULL) && ! limitsSet (tm) &&
+              (tm->breakAt < 0) && ! tm->breakIn )
+      result = jitRunTM (tm);
+    else result = runTM (tm);
+  }
+  if ( stepcnt != NULL ) *stepcnt += tm->steps;
+  tmFlush (tm);
+  return result;
+} /* tmRun */
@@ -0,0 +1,267 @@
+/****************************************************/
+/* File: tm.h                                       */
+/* Interface of libtm, the TM ("Tiny Machine")      */
+/* computer as a library: every TMContext is an     */
+/* independent machine with its own memories,       */
+/* registers and I/O, so many can run at once,      */
+/* one per thread                                   */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#ifndef _TM_H_
+#define _TM_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/******* const *******/
+#define   IADDR_DEFAULT  1024
+#define   DADDR_DEFAULT  1024
+#define   ADDR_MAX  (1 << 28) /* largest iMem or dMem size */
+#define   NO_REGS 8
+#define   PC_REG  7
+
+#define   LINESIZE  121
+#define   WORDSIZE  20
+
+/******* type  *******/
+
+typedef enum {
+   /* RR instructions */
+   opHALT,    /* RR     halt, operands are ignored */
+   opIN,      /* RR     read into reg(r); s and t are ignored */
+   opOUT,     /* RR     write from reg(r), s and t are ignored */
+   opADD,    /* RR     reg(r) = reg(s)+reg(t) */
+   opSUB,    /* RR     reg(r) = reg(s)-reg(t) */
+   opMUL,    /* RR     reg(r) = reg(s)*reg(t) */
+   opDIV,    /* RR     reg(r) = reg(s)/reg(t) */
+   opRRLim,   /* limit of RR opcodes */
+
+   /* RM instructions */
+   opLD,      /* RM     reg(r) = mem(d+reg(s)) */
+   opST,      /* RM     mem(d+reg(s)) = reg(r) */
+   opRMLim,   /* Limit of RM opcodes */
+
+   /* RA instructions */
+   opLDA,     /* RA     reg(r) = d+reg(s) */
+   opLDC,     /* RA     reg(r) = d ; reg(s) is ignored */
+   opJLT,     /* RA     if reg(r)<0 then reg(7) = d+reg(s) */
+   opJLE,     /* RA     if reg(r)<=0 then reg(7) = d+reg(s) */
+   opJGT,     /* RA     if reg(r)>0 then reg(7) = d+reg(s) */
+   opJGE,     /* RA     if reg(r)>=0 then reg(7) = d+reg(s) */
+   opJEQ,     /* RA     if reg(r)==0 then reg(7) = d+reg(s) */
+   opJNE,     /* RA     if reg(r)!=0 then reg(7) = d+reg(s) */
+   opRALim    /* Limit of RA opcodes */
+   } OPCODE;
+
+typedef enum {
+   srOKAY,
+   srHALT,
+   srIMEM_ERR,
+   srDMEM_ERR,
+   srZERODIVIDE,
+   srIN_ERR,
+   srFUEL,      /* fuelLimit instruction budget used up */
+   srTIMEOUT,   /* timeLimit wall-clock limit reached */
+   srBREAK,     /* stopped at breakAt, or before an IN with breakIn */
+   srOVERFLOW   /* division of the least integer by -1 */
+   } STEPRESULT;
+
+typedef struct {
+      int iop  ;
+      int iarg1  ;
+      int iarg2  ;
+      int iarg3  ;
+   } INSTRUCTION;
+
+typedef struct tmcontext TMContext;
+
+/* saved machine state: registers and the touched dMem pages */
+typedef struct tmsnapshot TMSnapshot;
+
+/* I/O hooks replacing the batch runtime, e.g. to
+ * prompt at a terminal; input returns srOKAY or
+ * srIN_ERR
+ */
+typedef STEPRESULT (* TMInput) ( TMContext * tm, int * val );
+typedef void (* TMOutput) ( TMContext * tm, int val );
+/* trace hook, called before the instruction at pc */
+typedef void (* TMTrace) ( TMContext * tm, int pc );
+
+/* private parts of a context */
+struct tmdecoded;
+struct tmprof;
+struct tmhist;
+
+struct tmcontext {
+      /* the machine; iMem, code and dMem share one
+       * anonymous mapping whose pages read as zero
+       * until written, and a zero INSTRUCTION is
+       * HALT 0,0,0
+       */
+      int iaddrSize, daddrSize ;
+      int codeSize ;  /* decoded part of iMem: up to the first unused HALT */
+      INSTRUCTION * iMem ;
+      int * dMem ;
+      int reg [NO_REGS] ;
+      struct tmdecoded * code ;
+      int handlersFor ;  /* breakAt the run loop's handlers were set for */
+      char * mem ;
+      size_t memLen ;
+
+      /* options: fuse, profile and history take
+       * effect at tmLoad, the others at tmRun
+       */
+      int jit ;          /* run with the x86-64 JIT where possible */
+      int fuse ;         /* fuse superinstructions (default TRUE) */
+      int binary ;       /* batch IN/OUT as raw int32 */
+      int profile ;      /* collect a profile for tmProfileReport */
+      int history ;      /* steps kept for tmStepBack, 0 for none */
+      long fuelLimit ;   /* instructions per run, 0 for none */
+      double timeLimit ; /* seconds per run, 0 for none */
+      int breakAt ;      /* stop before this location, -1 for none */
+      int breakIn ;      /* stop before every IN */
+      TMInput input ;    /* NULL: batch input */
+      TMOutput output ;  /* NULL: batch output */
+      TMTrace trace ;    /* NULL: no trace */
+      void * user ;      /* for the hooks */
+
+      /* results */
+      char name [120] ;  /* program file */
+      char errMsg [LINESIZE+40] ; /* why tmLoad failed */
+      long steps ;       /* instructions of the last counted tmRun */
+      double runStart ;  /* clock at the start of the last run */
+
+      /* line scanner of the loader, shared with
+       * command interpreters through tmGetNum and
+       * friends
+       */
+      char line [LINESIZE] ;
+      int lineLen ;
+      int inCol ;
+      int num ;
+      char word [WORDSIZE] ;
+      char ch ;
+
+      /* fusion statistics */
+      int * fuseSites ;
+      long fuseSaved ;
+
+      /* batch input: a regular file is mapped whole,
+       * anything else is read through inBuf
+       */
+      int inFd ;
+      int inOwnFd ;      /* inFd was opened by tmSetInputFile */
+      unsigned char * inBuf ;
+      size_t inPos, inLen ;
+      int inWhole ;      /* all input is in inBuf */
+      int inKind ;       /* inBuf is 0 borrowed, 1 malloc'd, 2 mapped */
+
+      /* batch output: collected in outBuf and written
+       * to outFd in bulk, or kept when outFd is -1
+       */
+      int outFd ;
+      char * outBuf ;
+      size_t outLen, outSize ;
+
+      /* JIT code, compiled on first use */
+      unsigned char * jitBuf ;
+      int jitSize ;
+      void ** jitTab ;
+      int (* jitEntry) ( int pc ) ;
+
+      struct tmprof * prof ;
+      struct tmhist * hist ;
+   };
+
+/******* vars  *******/
+extern char * opCodeTab[];
+extern char * stepResultTab[];
+
+/******* functions *******/
+
+/* tmCreate returns a machine with iaddrSize iMem
+ * and daddrSize dMem locations, or NULL if they
+ * cannot be mapped
+ */
+TMContext * tmCreate ( int iaddrSize, int daddrSize );
+
+/* tmDestroy releases a machine and everything it owns */
+void tmDestroy ( TMContext * tm );
+
+/* tmLoad reads a TM program and prepares it to
+ * run; tmLoadFile reads it from file name.
+ * They return FALSE with the reason in errMsg.
+ */
+int tmLoad ( TMContext * tm, FILE * pgm );
+int tmLoadFile ( TMContext * tm, char * name );
+
+/* tmReset clears registers and dMem for a new
+ * execution of the loaded program
+ */
+void tmReset ( TMContext * tm );
+
+/* tmSnapshot saves the registers, pc and touched
+ * dMem pages; tmRestore puts them back into a
+ * machine with the same dMem size, FALSE if the
+ * size differs. tmClone returns a new machine
+ * with the loaded program and the state of tm.
+ */
+TMSnapshot * tmSnapshot ( TMContext * tm );
+int tmRestore ( TMContext * tm, TMSnapshot * snap );
+int tmSnapshotPages ( TMSnapshot * snap );
+void tmFreeSnapshot ( TMSnapshot * snap );
+TMContext * tmClone ( TMContext * tm );
+
+/* tmStep executes one instruction */
+STEPRESULT tmStep ( TMContext * tm );
+
+/* tmRun executes instructions until a result
+ * other than srOKAY and writes pending output.
+ * A run that starts at a break resumes past it.
+ * The instructions executed are added to
+ * *stepcnt; with stepcnt NULL, the count is not
+ * needed and the JIT may run.
+ */
+STEPRESULT tmRun ( TMContext * tm, long * stepcnt );
+
+/* batch I/O: input from file name (stdin if
+ * NULL) or from the len bytes at buf, which must
+ * outlive the runs; output to fd, or kept in
+ * memory for tmOutput if fd is -1
+ */
+int tmSetInputFile ( TMContext * tm, char * name );
+void tmSetInputBuffer ( TMContext * tm, const char * buf, size_t len );
+void tmSetOutputFd ( TMContext * tm, int fd );
+char * tmOutput ( TMContext * tm, size_t * len );
+void tmFlush ( TMContext * tm );
+
+/* line scanner over tm->line */
+int tmGetNum ( TMContext * tm );
+int tmGetWord ( TMContext * tm );
+int tmSkipCh ( TMContext * tm, char c );
+int tmAtEOL ( TMContext * tm );
+
+/* tmStepBack undoes the last step kept in the
+ * history: its register or dMem write and the
+ * pc, but not its input or output. FALSE when
+ * no step is left.
+ */
+int tmStepBack ( TMContext * tm );
+
+/* reports */
+void tmWriteInstruction ( TMContext * tm, FILE * f, int loc );
+void tmLimitReport ( TMContext * tm, FILE * f, STEPRESULT result );
+void tmFuseReport ( TMContext * tm, FILE * f );
+void tmHistoryReport ( TMContext * tm, FILE * f, int n );
+int tmProfileReport ( TMContext * tm, char * name );
+
+#endif
@@ -0,0 +1,387 @@
+/****************************************************/
+/* File: tm2c.c                                     */
+/* Translates a TM program to a C program that      */
+/* behaves like "tm --run" on it: the same output,  */
+/* fault messages and exit status                   */
+/*                                                  */
+/* Every location a jump can be seen to reach       */
+/* starts a block of straight-line C code and is a  */
+/* case of a switch on the pc for computed jumps.   */
+/* A computed jump to any other location runs the   */
+/* instructions one at a time until it reaches a    */
+/* block, so every TM program translates exactly.   */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tm.h"
+
+/******** vars ********/
+static FILE * out;           /* the C program */
+static TMContext * tm;       /* holds the program read */
+static char * leader;        /* a block starts at loc: 1, also a goto target: 2 */
+
+/* runtime of the translated program: batch I/O
+ * as in libtm, and stepTM for computed jumps
+ * into the middle of a block
+ */
+static char * runtime[] = {
+"static int dMem[DADDR_SIZE];",
+"",
+"/* the result names of tm.c */",
+"static const char * stepResultTab[] = {",
+"   \"OK\", \"Halted\", \"Instruction Memory Fault\",",
+"   \"Data Memory Fault\", \"Division by 0\", \"Input Error\",",
+"   \"Instruction Limit Exceeded\", \"Time Limit Exceeded\", \"Breakpoint\",",
+"   \"Division Overflow\" };",
+"",
+"/* finish ends the run with result res as tm --run does */",
+"static void finish ( int res )",
+"{ fflush(stdout);",
+"  if ( res == 1 ) exit(0);",
+"  fprintf(stderr, \"%s\\n\", stepResultTab[res]);",
+"  exit(res);",
+"}",
+"",
+"/* readInt reads a decimal integer after white space; 0 on success */",
+"static int readInt ( int * val )",
+"{ unsigned int v = 0;",
+"  int c, neg = 0;",
+"  do c = getchar_unlocked(); while ( (c != EOF) && isspace(c) );",
+"  if ( (c == '-') || (c == '+') )",
+"  { neg = (c == '-');",
+"    c = getchar_unlocked();",
+"  }",
+"  if ( (c == EOF) || ! isdigit(c) ) return 5;",
+"  do",
+"  { v = v * 10 + (c - '0');",
+"    c = getchar_unlocked();",
+"  } while ( (c != EOF) && isdigit(c) );",
+"  if ( c != EOF ) ungetc(c, stdin);",
+"  *val = (int) (neg ? -v : v);",
+"  return 0;",
+"}",
+"",
+"static void writeInt ( int val )",
+"{ char digits[12];",
+"  unsigned int v = (val < 0) ? - (unsigned int) val : (unsigned int) val;",
+"  int n = 0;",
+"  do",
+"  { digits[n++] = '0' + v % 10;",
+"    v /= 10;",
+"  } while ( v != 0 );",
+"  if ( val < 0 ) putchar_unlocked('-');",
+"  while ( n > 0 ) putchar_unlocked(digits[--n]);",
+"  putchar_unlocked('\\n');",
+"}",
+"",
+"/* stepTM executes the instruction at reg[7] as tm.c does */",
+"static int stepTM ( int * reg )",
+"{ int pc = reg[7];",
+"  const int * in;",
+"  int r, s, t;",
+"  unsigned m = 0;",
+"  if ( (pc < 0) || (pc >= IADDR_SIZE) ) return 2;",
+"  reg[7] = pc + 1;",
+"  if ( pc >= CODE_SIZE ) return 1;",
+"  in = iMem[pc];",
+"  r = in[1]; s = in[2]; t = in[3];",
+"  if ( in[0] > 6 )",
+"  { m = (unsigned) in[2] + (unsigned) reg[t];",
+"    if ( ((in[0] == 8) || (in[0] == 9)) && (m >= DADDR_SIZE) ) return 3;",
+"  }",
+"  switch ( in[0] )",
+"  { case 0 : return 1;",
+"    case 1 : return readInt(&reg[r]);",
+"    case 2 : writeInt(reg[r]); break;",
+"    case 3 : reg[r] = (int) ((unsigned) reg[s] + (unsigned) reg[t]); break;",
+"    case 4 : reg[r] = (int) ((unsigned) reg[s] - (unsigned) reg[t]); break;",
+"    case 5 : reg[r] = (int) ((unsigned) reg[s] * (unsigned) reg[t]); break;",
+"    case 6 : if ( reg[t] == 0 ) return 4;",
+"             if ( (reg[s] == INT_MIN) && (reg[t] == -1) ) return 9;",
+"             reg[r] = reg[s] / reg[t]; break;",
+"    case 8 : reg[r] = dMem[m]; break;",
+"    case 9 : dMem[m] = reg[r]; break;",
+"    case 11 : reg[r] = (int) m; break;",
+"    case 12 : reg[r] = in[2]; break;",
+"    case 13 : if ( reg[r] <  0 ) reg[7] = (int) m; break;",
+"    case 14 : if ( reg[r] <= 0 ) reg[7] = (int) m; break;",
+"    case 15 : if ( reg[r] >  0 ) reg[7] = (int) m; break;",
+"    case 16 : if ( reg[r] >= 0 ) reg[7] = (int) m; break;",
+"    case 17 : if ( reg[r] == 0 ) reg[7] = (int) m; break;",
+"    case 18 : if ( reg[r] != 0 ) reg[7] = (int) m; break;",
+"  }",
+"  return 0;",
+"}",
+"",
+NULL };
+
+/********************************************/
+/* reg returns the C expression for register */
+/* r read by the instruction at loc: the pc  */
+/* reads as the next location.               */
+/********************************************/
+static char * reg ( int r, int loc )
+{ static char buf[4][20];
+  static int n = 0;
+  n = (n + 1) % 4;
+  if ( r == PC_REG ) sprintf(buf[n], "%d", loc + 1);
+  else sprintf(buf[n], "r%d", r);
+  return buf[n];
+} /* reg */
+
+/********************************************/
+/* markLeaders finds the blocks: location 0, */
+/* the targets of jumps relative to the pc   */
+/* or to a constant, and the locations the   */
+/* program takes with LDA r,d(7), such as    */
+/* return addresses.                         */
+/********************************************/
+static void markLeaders ( void )
+{ int loc, target;
+  INSTRUCTION * in;
+  leader[0] = 1;
+  for (loc = 0; loc < tm->codeSize; loc++)
+  { in = &tm->iMem[loc];
+    target = -1;
+    if ( in->iop == opLDC ) target = (in->iarg1 == PC_REG) ? in->iarg2 : -1;
+    else if ( ((in->iop == opLDA) || (in->iop >= opJLT)) &&
+              (in->iarg3 == PC_REG) )
+      target = loc + 1 + in->iarg2;
+    if ( (target >= 0) && (target < tm->codeSize) )
+    { if ( (in->iarg1 == PC_REG) || (in->iop >= opJLT) ) leader[target] = 2;
+      else if ( leader[target] == 0 ) leader[target] = 1;
+    }
+  }
+} /* markLeaders */
+
+/********************************************/
+/* endsPath tells if execution never goes on */
+/* from the instruction at loc to the next.  */
+/********************************************/
+static int endsPath ( int loc )
+{ INSTRUCTION * in = &tm->iMem[loc];
+  if ( in->iop == opHALT ) return TRUE;
+  return (in->iarg1 == PC_REG) && (in->iop != opOUT) &&
+         (in->iop != opST) && (in->iop < opJLT);
+} /* endsPath */
+
+/********************************************/
+/* emitJump ends a path through the block at */
+/* target, an expression when it is NULL.    */
+/********************************************/
+static void emitJump ( int target, char * expr )
+{ if ( expr != NULL ) fprintf(out, "{ pc = %s; goto dispatch; }", expr);
+  else if ( (target >= 0) && (target < tm->codeSize) )
+    fprintf(out, "goto L%d;", target);
+  else fprintf(out, "{ pc = %d; goto dispatch; }", target);
+} /* emitJump */
+
+/********************************************/
+/* emitSet writes value to register r; a     */
+/* write to the pc is a computed jump.       */
+/********************************************/
+static void emitSet ( int r, char * value )
+{ if ( r == PC_REG ) emitJump (0, value);
+  else fprintf(out, "r%d = %s;", r, value);
+} /* emitSet */
+
+/********************************************/
+/* emitAddr checks the dMem address d+reg(s) */
+/* and leaves it in a, or returns the        */
+/* constant address, -1 if always outside.   */
+/********************************************/
+static int emitAddr ( int loc, int d, int s )
+{ int m;
+  if ( s == PC_REG )
+  { m = loc + 1 + d;
+    if ( (m >= 0) && (m < tm->daddrSize) ) return m;
+    fprintf(out, "finish(3);");
+    return -1;
+  }
+  fprintf(out, "a = (unsigned) r%d + %d; if ( a >= DADDR_SIZE ) finish(3);\n    ",
+          s, d);
+  return -2;
+} /* emitAddr */
+
+/********************************************/
+/* emitInstruction writes the C code of the  */
+/* instruction at loc                        */
+/********************************************/
+static void emitInstruction ( int loc )
+{ INSTRUCTION * in = &tm->iMem[loc];
+  int r = in->iarg1, s, t, d, m;
+  char value[60];
+  static char * opTab[] = { "+", "-", "*" };
+  static char * condTab[] = { "<", "<=", ">", ">=", "==", "!=" };
+  if ( leader[loc] && (loc > 0) && ! endsPath (loc - 1) )
+    fprintf(out, "    /* fall through */\n");
+  if ( leader[loc] == 2 ) fprintf(out, "  case %d: L%d:\n", loc, loc);
+  else if ( leader[loc] ) fprintf(out, "  case %d:\n", loc);
+  fprintf(out, "    ");
+  switch ( in->iop )
+  { case opHALT :
+      fprintf(out, "finish(1);");
+      break;
+    case opIN :
+      fprintf(out, "if ( readInt(&v) ) finish(5);\n    ");
+      emitSet (r, "v");
+      break;
+    case opOUT :
+      fprintf(out, "writeInt(%s);", reg(r, loc));
+      break;
+    case opADD :
+    case opSUB :
+    case opMUL :
+      sprintf(value, "(int) ((unsigned) %s %s (unsigned) %s)",
+              reg(in->iarg2, loc), opTab[in->iop - opADD], reg(in->iarg3, loc));
+      emitSet (r, value);
+      break;
+    case opDIV :
+      s = in->iarg2;
+      t = in->iarg3;
+      fprintf(out, "if ( %s == 0 ) finish(4);\n    ", reg(t, loc));
+      fprintf(out, "if ( (%s == INT_MIN) && (%s == -1) ) finish(9);\n    ",
+              reg(s, loc), reg(t, loc));
+      sprintf(value, "%s / %s", reg(s, loc), reg(t, loc));
+      emitSet (r, value);
+      break;
+    case opLD :
+      m = emitAddr (loc, in->iarg2, in->iarg3);
+      if ( m == -1 ) break;
+      if ( m >= 0 ) sprintf(value, "dMem[%d]", m);
+      else strcpy(value, "dMem[a]");
+      emitSet (r, value);
+      break;
+    case opST :
+      m = emitAddr (loc, in->iarg2, in->iarg3);
+      if ( m == -1 ) break;
+      if ( m >= 0 ) fprintf(out, "dMem[%d] = %s;", m, reg(r, loc));
+      else fprintf(out, "dMem[a] = %s;", reg(r, loc));
+      break;
+    case opLDA :
+    case opLDC :
+      s = in->iarg3;
+      d = in->iarg2;
+      if ( (in->iop == opLDC) || (s == PC_REG) )
+      { if ( in->iop == opLDA ) d = loc + 1 + d;
+        if ( r == PC_REG ) emitJump (d, NULL);
+        else fprintf(out, "r%d = %d;", r, d);
+      }
+      else
+      { sprintf(value, "(int) ((unsigned) r%d + %d)", s, d);
+        emitSet (r, value);
+      }
+      break;
+    default : /* conditional jumps */
+      fprintf(out, "if ( %s %s 0 ) ", reg(r, loc), condTab[in->iop - opJLT]);
+      if ( in->iarg3 == PC_REG ) emitJump (loc + 1 + in->iarg2, NULL);
+      else
+      { sprintf(value, "(int) ((unsigned) r%d + %d)", in->iarg3, in->iarg2);
+        emitJump (0, value);
+      }
+      break;
+  }
+  fprintf(out, "  /* %d: %s %d,", loc, opCodeTab[in->iop], r);
+  if ( in->iop < opRRLim ) fprintf(out, "%d,%d */\n", in->iarg2, in->iarg3);
+  else fprintf(out, "%d(%d) */\n", in->iarg2, in->iarg3);
+} /* emitInstruction */
+
+/********************************************/
+/* emitProgram writes the translated program */
+/********************************************/
+static void emitProgram ( char * name )
+{ int loc, i;
+  INSTRUCTION * in;
+  fprintf(out, "/* %s translated by tm2c */\n\n", name);
+  fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n#include <ctype.h>\n#include <limits.h>\n\n");
+  fprintf(out, "#define IADDR_SIZE %d\n", tm->iaddrSize);
+  fprintf(out, "#define DADDR_SIZE %du\n", tm->daddrSize);
+  fprintf(out, "#define CODE_SIZE %d\n\n", tm->codeSize);
+  fprintf(out, "/* op, r, s or d, t or s of every location */\n");
+  fprintf(out, "static const int iMem[CODE_SIZE][4] = {\n");
+  for (loc = 0; loc < tm->codeSize; loc++)
+  { in = &tm->iMem[loc];
+    fprintf(out, "  { %d, %d, %d, %d },\n", in->iop, in->iarg1, in->iarg2, in->iarg3);
+  }
+  fprintf(out, "};\n\nstatic const char leader[CODE_SIZE] = {");
+  for (loc = 0; loc < tm->codeSize; loc++)
+    fprintf(out, "%s%d,", (loc % 32) ? "" : "\n  ", leader[loc] != 0);
+  fprintf(out, "\n};\n\n");
+  for (i = 0; runtime[i] != NULL; i++) fprintf(out, "%s\n", runtime[i]);
+
+  fprintf(out, "int main ( void )\n");
+  fprintf(out, "{ int r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0;\n");
+  fprintf(out, "  int pc = 0, v, res;\n  unsigned a;\n  int reg[8];\n");
+  fprintf(out, "  a = v = 0;\n  dMem[0] = DADDR_SIZE - 1;\n");
+  fprintf(out, "dispatch:\n  switch ( pc )\n  { default: goto step;\n");
+  for (loc = 0; loc < tm->codeSize; loc++) emitInstruction (loc);
+  fprintf(out, "  }\n");
+  fprintf(out, "step: /* not the start of a block */\n");
+  fprintf(out, "  reg[0] = r0; reg[1] = r1; reg[2] = r2; reg[3] = r3;\n");
+  fprintf(out, "  reg[4] = r4; reg[5] = r5; reg[6] = r6; reg[7] = pc;\n");
+  fprintf(out, "  do res = stepTM(reg);\n");
+  fprintf(out, "  while ( (res == 0) && ((reg[7] < 0) || (reg[7] >= CODE_SIZE) ||\n");
+  fprintf(out, "          ! leader[reg[7]]) );\n");
+  fprintf(out, "  if ( res != 0 ) finish(res);\n");
+  fprintf(out, "  r0 = reg[0]; r1 = reg[1]; r2 = reg[2]; r3 = reg[3];\n");
+  fprintf(out, "  r4 = reg[4]; r5 = reg[5]; r6 = reg[6]; pc = reg[7];\n");
+  fprintf(out, "  goto dispatch;\n}\n");
+} /* emitProgram */
+
+/********************************************/
+/* E X E C U T I O N   B E G I N S   H E R E */
+/********************************************/
+
+int main ( int argc, char * argv[] )
+{ char * fileName = NULL;
+  char * outName = NULL;
+  char pgmName[120];
+  int iaddrSize = IADDR_DEFAULT;
+  int daddrSize = DADDR_DEFAULT;
+  int i;
+  for (i = 1; i < argc; i++)
+  { if ((strcmp(argv[i],"-o") == 0) && (i+1 < argc))
+      outName = argv[++i];
+    else if ((strcmp(argv[i],"--imem") == 0) && (i+1 < argc))
+      iaddrSize = atoi(argv[++i]);
+    else if ((strcmp(argv[i],"--dmem") == 0) && (i+1 < argc))
+      daddrSize = atoi(argv[++i]);
+    else if (fileName == NULL) fileName = argv[i];
+    else break;
+  }
+  if ((i < argc) || (fileName == NULL) ||
+      (iaddrSize <= 0) || (iaddrSize > ADDR_MAX) ||
+      (daddrSize <= 0) || (daddrSize > ADDR_MAX))
+  { printf("usage: %s [--imem <n>] [--dmem <n>] [-o <file.c>] <filename>\n",argv[0]);
+    exit(1);
+  }
+  tm = tmCreate (iaddrSize, daddrSize);
+  if ( tm == NULL )
+  { printf("cannot allocate %d iMem and %d dMem locations\n",
+           iaddrSize,daddrSize);
+    exit(1);
+  }
+  tm->fuse = FALSE;
+  strncpy(pgmName,fileName,sizeof(pgmName)-4) ;
+  pgmName[sizeof(pgmName)-4] = '\0';
+  if (strchr (pgmName, '.') == NULL)
+     strcat(pgmName,".tm");
+  if ( ! tmLoadFile (tm, pgmName) )
+  { printf("%s\n", tm->errMsg);
+    exit(1);
+  }
+  out = (outName == NULL) ? stdout : fopen(outName, "w");
+  if ( out == NULL )
+  { printf("Unable to open %s\n", outName);
+    exit(1);
+  }
+  leader = (char *) calloc(tm->codeSize, 1);
+  markLeaders ();
+  emitProgram (pgmName);
+  if ( out != stdout ) fclose(out);
+  free(leader);
+  tmDestroy (tm);
+  return 0;
+}
@@ -0,0 +1,225 @@
+/****************************************************/
+/* File: tmharness.c                                */
+/* Runs many independent TM program/input pairs in  */
+/* one process, one libtm context per job, on a     */
+/* pool of threads                                  */
+/*                                                  */
+/* The job list has one job per line:               */
+/*    <program.tm> <input file | -> [<expected>]    */
+/* A job passes when its program halts and, if an   */
+/* expected output file is given, its output equals */
+/* that file.                                       */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "tm.h"
+
+#define   PATHSIZE  256
+
+typedef struct {
+      char pgm [PATHSIZE] ;
+      char input [PATHSIZE] ;
+      char expect [PATHSIZE] ;   /* empty when not checked */
+      /* results */
+      int loaded ;
+      STEPRESULT result ;
+      int passed ;
+      long steps ;
+      char msg [PATHSIZE+40] ;
+   } JOB;
+
+/******** vars ********/
+JOB * jobs = NULL;
+int nJobs = 0;
+int nextJob = 0;   /* next job to hand out */
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+
+int iaddrSize = IADDR_DEFAULT;
+int daddrSize = DADDR_DEFAULT;
+int jitflag = FALSE;
+int countflag = FALSE;
+int verbose = FALSE;
+long fuelLimit = 0;
+double timeLimit = 0;
+
+/********************************************/
+/* readFile returns the contents of file     */
+/* name in a malloc'd buffer and its length  */
+/* in *len, or NULL.                         */
+/********************************************/
+static char * readFile ( char * name, size_t * len )
+{ FILE * f = fopen(name, "rb");
+  char * buf;
+  long n;
+  if ( f == NULL ) return NULL;
+  fseek(f, 0, SEEK_END);
+  n = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  buf = (char *) malloc(n + 1);
+  if ( (buf != NULL) && (fread(buf, 1, n, f) != (size_t) n) )
+  { free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  *len = n;
+  return buf;
+} /* readFile */
+
+/********************************************/
+/* runJob runs one job in a context of its   */
+/* own and records the result in it.         */
+/********************************************/
+static void runJob ( JOB * job )
+{ TMContext * tm = tmCreate (iaddrSize, daddrSize);
+  char * out, * want;
+  size_t outLen, wantLen;
+  if ( tm == NULL )
+  { sprintf(job->msg, "cannot allocate the machine");
+    return;
+  }
+  tm->jit = jitflag;
+  tm->fuelLimit = fuelLimit;
+  tm->timeLimit = timeLimit;
+  tmSetOutputFd (tm, -1);
+  if ( ! tmLoadFile (tm, job->pgm) )
+  { snprintf(job->msg, sizeof(job->msg), "%s", tm->errMsg);
+    tmDestroy (tm);
+    return;
+  }
+  if ( strcmp(job->input, "-") == 0 ) tmSetInputBuffer (tm, "", 0);
+  else if ( ! tmSetInputFile (tm, job->input) )
+  { snprintf(job->msg, sizeof(job->msg), "file '%s' not found", job->input);
+    tmDestroy (tm);
+    return;
+  }
+  job->loaded = TRUE;
+  job->result = tmRun (tm, countflag ? &job->steps : NULL);
+  job->passed = (job->result == srHALT);
+  if ( job->passed && (job->expect[0] != '\0') )
+  { out = tmOutput (tm, &outLen);
+    want = readFile (job->expect, &wantLen);
+    if ( want == NULL )
+    { snprintf(job->msg, sizeof(job->msg), "file '%s' not found", job->expect);
+      job->passed = FALSE;
+    }
+    else if ( (outLen != wantLen) || (memcmp(out, want, outLen) != 0) )
+    { sprintf(job->msg, "wrong output");
+      job->passed = FALSE;
+    }
+    free(want);
+  }
+  tmDestroy (tm);
+} /* runJob */
+
+/********************************************/
+/* worker takes jobs until none are left.    */
+/********************************************/
+static void * worker ( void * arg )
+{ int j;
+  for (;;)
+  { pthread_mutex_lock(&jobLock);
+    j = nextJob++;
+    pthread_mutex_unlock(&jobLock);
+    if ( j >= nJobs ) break;
+    runJob (&jobs[j]);
+  }
+  return arg;
+} /* worker */
+
+/********************************************/
+/* readJobs reads the job list; FALSE if it  */
+/* cannot be read.                           */
+/********************************************/
+static int readJobs ( char * name )
+{ FILE * f = fopen(name, "r");
+  char line[3*PATHSIZE];
+  JOB job;
+  int n;
+  if ( f == NULL ) return FALSE;
+  while ( fgets(line, sizeof(line), f) != NULL )
+  { memset(&job, 0, sizeof(JOB));
+    n = sscanf(line, "%255s %255s %255s", job.pgm, job.input, job.expect);
+    if ( (n < 1) || (job.pgm[0] == '#') ) continue;
+    if ( n < 2 ) strcpy(job.input, "-");
+    jobs = (JOB *) realloc(jobs, (nJobs + 1) * sizeof(JOB));
+    jobs[nJobs++] = job;
+  }
+  fclose(f);
+  return TRUE;
+} /* readJobs */
+
+/********************************************/
+int main ( int argc, char * argv[] )
+{ char * listName = NULL;
+  int nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_t * threads;
+  struct timespec t0, t1;
+  int i, passed = 0, failed = 0;
+  long steps = 0;
+  for (i = 1; i < argc; i++)
+  { if ((strcmp(argv[i],"-j") == 0) && (i+1 < argc))
+      nThreads = atoi(argv[++i]);
+    else if (strcmp(argv[i],"--jit") == 0) jitflag = TRUE;
+    else if (strcmp(argv[i],"--stats") == 0) countflag = TRUE;
+    else if (strcmp(argv[i],"-v") == 0) verbose = TRUE;
+    else if ((strcmp(argv[i],"--fuel") == 0) && (i+1 < argc))
+      fuelLimit = atol(argv[++i]);
+    else if ((strcmp(argv[i],"--timeout") == 0) && (i+1 < argc))
+      timeLimit = atof(argv[++i]);
+    else if ((strcmp(argv[i],"--imem") == 0) && (i+1 < argc))
+      iaddrSize = atoi(argv[++i]);
+    else if ((strcmp(argv[i],"--dmem") == 0) && (i+1 < argc))
+      daddrSize = atoi(argv[++i]);
+    else if (listName == NULL) listName = argv[i];
+    else break;
+  }
+  if ((i < argc) || (listName == NULL) || (nThreads <= 0) ||
+      (iaddrSize <= 0) || (iaddrSize > ADDR_MAX) ||
+      (daddrSize <= 0) || (daddrSize > ADDR_MAX) ||
+      (fuelLimit < 0) || (timeLimit < 0))
+  { printf("usage: %s [-j <threads>] [-v] [--jit] [--stats] [--imem <n>] "
+           "[--dmem <n>] [--fuel <n>] [--timeout <seconds>] <joblist>\n",argv[0]);
+    exit(1);
+  }
+  if ( ! readJobs (listName) )
+  { printf("file '%s' not found\n",listName);
+    exit(1);
+  }
+  if ( nThreads > nJobs ) nThreads = (nJobs > 0) ? nJobs : 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  threads = (pthread_t *) malloc(nThreads * sizeof(pthread_t));
+  for (i = 0; i < nThreads; i++)
+    if ( pthread_create(&threads[i], NULL, worker, NULL) != 0 )
+    { nThreads = i;
+      break;
+    }
+  if ( nThreads == 0 ) worker (NULL);
+  for (i = 0; i < nThreads; i++) pthread_join(threads[i], NULL);
+  free(threads);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  for (i = 0; i < nJobs; i++)
+  { JOB * job = &jobs[i];
+    if ( job->passed ) passed++; else failed++;
+    steps += job->steps;
+    if ( job->passed && ! verbose ) continue;
+    printf("%5d %s %s: %s", i + 1, job->pgm, job->input,
+           job->passed ? "ok" : "FAIL");
+    if ( job->loaded && (job->result != srHALT) )
+      printf(" (%s)", stepResultTab[job->result]);
+    if ( job->msg[0] != '\0' ) printf(" (%s)", job->msg);
+    if ( countflag && job->loaded ) printf(" %ld instructions", job->steps);
+    printf("\n");
+  }
+  printf("%d jobs, %d passed, %d failed, %d threads, %.3f s\n",
+         nJobs, passed, failed, nThreads,
+         (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+  if ( countflag ) printf("Number of instructions executed = %ld\n", steps);
+  return failed > 0;
+}
@@ -0,0 +1,531 @@
+/****************************************************/
+/* File: tmmain.c                                   */
+/* Command interpreter of the TM ("Tiny Machine")   */
+/* computer, built on one libtm context             */
+/* Compiler Construction: Principles and Practice   */
+/* Kenneth C. Louden                                */
+/****************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tm.h"
+
+/******** vars ********/
+int iloc = 0 ;
+int dloc = 0 ;
+int traceflag = FALSE;
+int icountflag = FALSE;
+int batchflag = FALSE;
+char * profName = NULL; /* profile report file, NULL when not profiling */
+TMSnapshot * snap = NULL; /* state saved by k(eep */
+
+char pgmName[120];
+
+TMContext * tm;
+int done  ;
+
+/********************************************/
+/* readLine reads a command line into the    */
+/* line scanner of the machine. The end of   */
+/* the input ends the session.               */
+/********************************************/
+void readLine (void)
+{ fflush (stdin);
+  fflush (stdout);
+  if ( fgets(tm->line, LINESIZE, stdin) == NULL )
+  { printf("\nSimulation done.\n");
+    exit(0);
+  }
+  tm->lineLen = strlen(tm->line);
+  if ( (tm->lineLen > 0) && (tm->line[tm->lineLen-1] == '\n') )
+    tm->line[--tm->lineLen] = '\0';
+  tm->inCol = 0;
+} /* readLine */
+
+/********************************************/
+STEPRESULT promptInput ( TMContext * tm, int * val )
+{ int ok ;
+  do
+  { printf("Enter value for IN instruction: ") ;
+    readLine ();
+    ok = tmGetNum(tm);
+    if ( ! ok ) printf ("Illegal value\n");
+    else *val = tm->num;
+  }
+  while (! ok);
+  return srOKAY ;
+} /* promptInput */
+
+/********************************************/
+void printOutput ( TMContext * tm, int val )
+{ (void) tm;
+  printf ("OUT instruction prints: %d\n", val ) ;
+} /* printOutput */
+
+/********************************************/
+void traceInstruction ( TMContext * tm, int pc )
+{ tmWriteInstruction (tm, stdout, pc) ;
+} /* traceInstruction */
+
+/********************************************/
+/* printHalt prints the HALT that stopped    */
+/* the machine, as the interpreter always    */
+/* has.                                      */
+/********************************************/
+void printHalt (void)
+{ INSTRUCTION * in = &tm->iMem[tm->reg[PC_REG]-1];
+  printf("HALT: %1d,%1d,%1d\n",in->iarg1,in->iarg2,in->iarg3);
+} /* printHalt */
+
+/********************************************/
+/* limitReported returns TRUE if a run that  */
+/* ended with result gets the report of its  */
+/* state: when a limit stopped it, and when  */
+/* it faulted with limits set, as a sandbox  */
+/* running untrusted programs does.          */
+/********************************************/
+int limitReported ( STEPRESULT result )
+{ if ( (result == srFUEL) || (result == srTIMEOUT) ) return TRUE;
+  return ( (tm->fuelLimit > 0) || (tm->timeLimit > 0) ) &&
+         (result != srOKAY) && (result != srHALT) && (result != srBREAK);
+} /* limitReported */
+
+/********************************************/
+int doCommand (void)
+{ char cmd;
+  int stepcnt=0, i;
+  int printcnt;
+  int stepResult;
+  long runcnt;
+  do
+  { printf ("Enter command: ");
+    readLine ();
+  }
+  while (! tmGetWord (tm));
+
+  cmd = tm->word[0] ;
+  switch ( cmd )
+  { case 't' :
+    /***********************************/
+      traceflag = ! traceflag ;
+      tm->trace = traceflag ? traceInstruction : NULL ;
+      printf("Tracing now ");
+      if ( traceflag ) printf("on.\n"); else printf("off.\n");
+      break;
+
+    case 'h' :
+    /***********************************/
+      printf("Commands are:\n");
+      printf("   s(tep <n>      "\
+             "Execute n (default 1) TM instructions\n");
+      printf("   g(o            "\
+             "Execute TM instructions until HALT\n");
+      printf("   r(egs          "\
+             "Print the contents of the registers\n");
+      printf("   i(Mem <b <n>>  "\
+             "Print n iMem locations starting at b\n");
+      printf("   d(Mem <b <n>>  "\
+             "Print n dMem locations starting at b\n");
+      printf("   t(race         "\
+             "Toggle instruction trace\n");
+      printf("   p(rint         "\
+             "Toggle print of total instructions executed"\
+             " ('go' only)\n");
+      printf("   f(use          "\
+             "Print superinstruction fusion statistics\n");
+      printf("   b(reak <n|in>  "\
+             "Stop 'go' before location n, or before every IN;"\
+             " clear if none\n");
+      printf("   w(here <n>     "\
+             "Print the last n (default 10) instructions executed\n");
+      printf("   u(ndo <n>      "\
+             "Step back n (default 1) instructions\n");
+      printf("   k(eep          "\
+             "Save registers and touched dMem\n");
+      printf("   l(oad          "\
+             "Restore the state saved by keep\n");
+      printf("   c(lear         "\
+             "Reset simulator for new execution of program\n");
+      printf("   h(elp          "\
+             "Cause this list of commands to be printed\n");
+      printf("   q(uit          "\
+             "Terminate the simulation\n");
+      break;
+
+    case 'p' :
+    /***********************************/
+      icountflag = ! icountflag ;
+      printf("Printing instruction count now ");
+      if ( icountflag ) printf("on.\n"); else printf("off.\n");
+      break;
+
+    case 'f' :
+    /***********************************/
+      tmFuseReport (tm, stdout);
+      break;
+
+    case 's' :
+    /***********************************/
+      if ( tmAtEOL (tm))  stepcnt = 1;
+      else if ( tmGetNum (tm))  stepcnt = abs(tm->num);
+      else   printf("Step count?\n");
+      break;
+
+    case 'g' :   stepcnt = 1 ;     break;
+
+    case 'r' :
+    /***********************************/
+      for (i = 0; i < NO_REGS; i++)
+      { printf("%1d: %4d    ", i,tm->reg[i]);
+        if ( (i % 4) == 3 ) printf ("\n");
+      }
+      break;
+
+    case 'i' :
+    /***********************************/
+      printcnt = 1 ;
+      if ( tmGetNum (tm))
+      { iloc = tm->num ;
+        if ( tmGetNum (tm)) printcnt = tm->num ;
+      }
+      if ( ! tmAtEOL (tm))
+        printf ("Instruction locations?\n");
+      else
+      { while ((iloc >= 0) && (iloc < tm->iaddrSize)
+                && (printcnt > 0) )
+        { tmWriteInstruction(tm, stdout, iloc);
+          iloc++ ;
+          printcnt-- ;
+        }
+      }
+      break;
+
+    case 'd' :
+    /***********************************/
+      printcnt = 1 ;
+      if ( tmGetNum (tm))
+      { dloc = tm->num ;
+        if ( tmGetNum (tm)) printcnt = tm->num ;
+      }
+      if ( ! tmAtEOL (tm))
+        printf("Data locations?\n");
+      else
+      { while ((dloc >= 0) && (dloc < tm->daddrSize)
+                  && (printcnt > 0))
+        { printf("%5d: %5d\n",dloc,tm->dMem[dloc]);
+          dloc++;
+          printcnt--;
+        }
+      }
+      break;
+
+    case 'c' :
+    /***********************************/
+      iloc = 0;
+      dloc = 0;
+      stepcnt = 0;
+      tmReset (tm);
+      break;
+
+    case 'b' :
+    /***********************************/
+      if ( tmAtEOL (tm))
+      { tm->breakAt = -1;
+        tm->breakIn = FALSE;
+        printf("Breakpoint cleared.\n");
+      }
+      else if ( tmGetNum (tm) && (tm->num >= 0) && (tm->num < tm->iaddrSize))
+      { tm->breakAt = tm->num;
+        printf("Breakpoint at instruction %d.\n", tm->breakAt);
+      }
+      else if ( tmGetWord (tm) && (strcmp(tm->word, "in") == 0))
+      { tm->breakIn = TRUE;
+        printf("Breakpoint before every IN.\n");
+      }
+      else printf("Breakpoint?\n");
+      break;
+
+    case 'w' :
+    case 'u' :
+    /***********************************/
+      printcnt = (cmd == 'w') ? 10 : 1;
+      if ( tmGetNum (tm)) printcnt = abs(tm->num);
+      if ( ! tmAtEOL (tm)) printf("Step count?\n");
+      else if ( tm->history <= 0 )
+        printf("No history; run with --history <n>.\n");
+      else if ( cmd == 'w' ) tmHistoryReport (tm, stdout, printcnt);
+      else
+      { i = 0;
+        while ((i < printcnt) && tmStepBack (tm)) i++;
+        if ( i < printcnt ) printf("No more history.\n");
+        iloc = tm->reg[PC_REG];
+        tmWriteInstruction (tm, stdout, iloc);
+      }
+      break;
+
+    case 'k' :
+    /***********************************/
+      tmFreeSnapshot (snap);
+      snap = tmSnapshot (tm);
+      if ( snap == NULL ) printf("Out of memory.\n");
+      else printf("Snapshot at instruction %d, %d dMem pages.\n",
+                  tm->reg[PC_REG], tmSnapshotPages (snap));
+      break;
+
+    case 'l' :
+    /***********************************/
+      if ( snap == NULL ) printf("No snapshot.\n");
+      else
+      { tmRestore (tm, snap);
+        printf("Restored to instruction %d.\n", tm->reg[PC_REG]);
+      }
+      break;
+
+    case 'q' : return FALSE;  /* break; */
+
+    default : printf("Command %c unknown.\n", cmd); break;
+  }  /* case */
+  stepResult = srOKAY;
+  if ( stepcnt > 0 )
+  { if ( cmd == 'g' )
+    { runcnt = 0;
+      stepResult = tmRun (tm, (tm->jit && ! icountflag) ? NULL : &runcnt);
+      if ( stepResult == srHALT ) printHalt ();
+      if ( icountflag )
+        printf("Number of instructions executed = %ld\n",runcnt);
+      if ( limitReported (stepResult) )
+        tmLimitReport (tm, stdout, stepResult);
+    }
+    else
+    { while ((stepcnt > 0) && (stepResult == srOKAY))
+      { iloc = tm->reg[PC_REG] ;
+        stepResult = tmStep (tm);
+        stepcnt-- ;
+      }
+      if ( stepResult == srHALT ) printHalt ();
+    }
+    printf( "%s\n",stepResultTab[stepResult] );
+  }
+  return TRUE;
+} /* doCommand */
+
+/********************************************/
+/* batchRun runs the program without prompts */
+/* on input file inName (stdin if NULL),     */
+/* counting the instructions in *runcnt.     */
+/* Returns the exit status for stepResult,   */
+/* or -1 if the input cannot be opened.      */
+/********************************************/
+int batchRun ( char * inName, long * runcnt, STEPRESULT * stepResult )
+{ *runcnt = 0;
+  if ( ! tmSetInputFile (tm, inName) )
+  { fprintf(stderr,"file '%s' not found\n",inName);
+    return -1;
+  }
+  *stepResult = tmRun (tm, (tm->jit && ! icountflag) ? NULL : runcnt);
+  if ( limitReported (*stepResult) )
+    tmLimitReport (tm, stderr, *stepResult);
+  if ( (*stepResult != srHALT) && (tm->history > 0) )
+  { fprintf(stderr,"Last instructions executed:\n");
+    tmHistoryReport (tm, stderr, tm->history < 20 ? tm->history : 20);
+  }
+  return (*stepResult == srHALT) ? 0 : *stepResult;
+} /* batchRun */
+
+/********************************************/
+/* inputRun runs one of the inputs after the */
+/* setup with the usual report.              */
+/********************************************/
+int inputRun ( char * inName )
+{ long runcnt;
+  STEPRESULT stepResult;
+  int code = batchRun (inName, &runcnt, &stepResult);
+  if ( code < 0 ) return 1;
+  if ( icountflag )
+    fprintf(stderr,"Number of instructions executed = %ld\n",runcnt);
+  if ( code != 0 ) fprintf(stderr,"%s\n",stepResultTab[stepResult]);
+  return code;
+} /* inputRun */
+
+/********************************************/
+/* setupRuns runs the program from stdin to  */
+/* the setup break, then each of the nIn     */
+/* inputs from the state there: restored     */
+/* from a snapshot, or in a fork()ed child   */
+/* that shares the pages copy-on-write.      */
+/* Returns the first non-zero exit status.   */
+/********************************************/
+int setupRuns ( char ** inNames, int nIn, int forkflag )
+{ long runcnt = 0;
+  STEPRESULT stepResult;
+  TMSnapshot * setup;
+  int i, status, exitCode = 0, code;
+  pid_t pid;
+  stepResult = tmRun (tm, &runcnt);
+  if ( icountflag )
+    fprintf(stderr,"Setup instructions executed = %ld\n",runcnt);
+  if ( stepResult != srBREAK )
+  { fprintf(stderr,"setup did not reach its break: %s\n",
+            stepResultTab[stepResult]);
+    return (stepResult == srHALT) ? 1 : stepResult;
+  }
+  tm->breakAt = -1;
+  tm->breakIn = FALSE;
+  setup = forkflag ? NULL : tmSnapshot (tm);
+  if ( ! forkflag && (setup == NULL) )
+  { fprintf(stderr,"cannot save the setup state\n");
+    return 1;
+  }
+  for (i = 0; i < nIn; i++)
+  { if ( forkflag )
+    { fflush(stdout);
+      fflush(stderr);
+      pid = fork();
+      if ( pid == 0 ) _exit(inputRun (inNames[i]));
+      if ( (pid < 0) || (waitpid(pid, &status, 0) != pid) )
+      { perror("fork");
+        code = 1;
+      }
+      else if ( WIFEXITED(status) ) code = WEXITSTATUS(status);
+      else code = 128 + WTERMSIG(status);
+    }
+    else
+    { if ( i > 0 ) tmRestore (tm, setup);
+      code = inputRun (inNames[i]);
+    }
+    if ( exitCode == 0 ) exitCode = code;
+  }
+  tmFreeSnapshot (setup);
+  return exitCode;
+} /* setupRuns */
+
+/********************************************/
+/* E X E C U T I O N   B E G I N S   H E R E */
+/********************************************/
+
+int main( int argc, char * argv[] )
+{ char ** inNames = (char **) calloc(argc, sizeof(char *));
+  int nIn = 0;
+  char * setupAt = NULL;  /* --setup: location, or "in" for the first IN */
+  int forkflag = FALSE;
+  char * fileName = NULL;
+  int iaddrSize = IADDR_DEFAULT;
+  int daddrSize = DADDR_DEFAULT;
+  int jitflag = FALSE;
+  int fuseflag = TRUE;
+  int binaryflag = FALSE; /* batch IN/OUT as raw int32 */
+  int history = 0 ;       /* --history: steps kept */
+  long fuelLimit = 0 ;    /* --fuel: instructions per run, 0 for none */
+  double timeLimit = 0 ;  /* --timeout: seconds per run, 0 for none */
+  int i, exitCode;
+  long runcnt;
+  STEPRESULT stepResult;
+  for (i = 1; i < argc; i++)
+  { if (strcmp(argv[i],"--run") == 0) batchflag = TRUE;
+    else if (strcmp(argv[i],"--jit") == 0) jitflag = TRUE;
+    else if (strcmp(argv[i],"--nofuse") == 0) fuseflag = FALSE;
+    else if (strcmp(argv[i],"--stats") == 0) icountflag = TRUE;
+    else if (strcmp(argv[i],"--binary") == 0) binaryflag = TRUE;
+    else if ((strcmp(argv[i],"--history") == 0) && (i+1 < argc))
+      history = atoi(argv[++i]);
+    else if ((strcmp(argv[i],"--fuel") == 0) && (i+1 < argc))
+      fuelLimit = atol(argv[++i]);
+    else if ((strcmp(argv[i],"--timeout") == 0) && (i+1 < argc))
+      timeLimit = atof(argv[++i]);
+    else if ((strcmp(argv[i],"--input") == 0) && (i+1 < argc))
+      inNames[nIn++] = argv[++i];
+    else if ((strcmp(argv[i],"--setup") == 0) && (i+1 < argc))
+      setupAt = argv[++i];
+    else if (strcmp(argv[i],"--fork") == 0) forkflag = TRUE;
+    else if ((strcmp(argv[i],"--profile") == 0) && (i+1 < argc))
+      profName = argv[++i];
+    else if ((strcmp(argv[i],"--imem") == 0) && (i+1 < argc))
+      iaddrSize = atoi(argv[++i]);
+    else if ((strcmp(argv[i],"--dmem") == 0) && (i+1 < argc))
+      daddrSize = atoi(argv[++i]);
+    else if (fileName == NULL) fileName = argv[i];
+    else break;
+  }
+  if ((i < argc) || (fileName == NULL) ||
+      (((nIn > 0) || binaryflag || (setupAt != NULL)) && ! batchflag) ||
+      ((nIn > 1) && (setupAt == NULL)) || (forkflag && (setupAt == NULL)) ||
+      (iaddrSize <= 0) || (iaddrSize > ADDR_MAX) ||
+      (daddrSize <= 0) || (daddrSize > ADDR_MAX) ||
+      (fuelLimit < 0) || (timeLimit < 0) || (history < 0) ||
+      ((setupAt != NULL) && (strcmp(setupAt, "in") != 0) &&
+       ((atoi(setupAt) < 0) || (atoi(setupAt) >= iaddrSize))))
+  { printf("usage: %s [--jit] [--nofuse] [--profile <file>] [--imem <n>] "
+           "[--dmem <n>] [--fuel <n>] [--timeout <seconds>] "
+           "[--history <n>] [--run [--stats] [--binary] [--input <file>] "
+           "[--setup <loc|in> [--fork] [--input <file>]...]] <filename>\n",
+           argv[0]);
+    exit(1);
+  }
+  tm = tmCreate (iaddrSize, daddrSize);
+  if ( tm == NULL )
+  { printf("cannot allocate %d iMem and %d dMem locations\n",
+           iaddrSize,daddrSize);
+    exit(1);
+  }
+  tm->jit = jitflag;
+  tm->fuse = fuseflag;
+  tm->binary = binaryflag;
+  tm->profile = (profName != NULL);
+  tm->fuelLimit = fuelLimit;
+  tm->timeLimit = timeLimit;
+  tm->history = history;
+  if ( (setupAt != NULL) && (strcmp(setupAt, "in") == 0) ) tm->breakIn = TRUE;
+  else if ( setupAt != NULL ) tm->breakAt = atoi(setupAt);
+  strncpy(pgmName,fileName,sizeof(pgmName)-4) ;
+  if (strchr (pgmName, '.') == NULL)
+     strcat(pgmName,".tm");
+
+  /* read the program */
+  if ( ! tmLoadFile (tm, pgmName) )
+  { printf("%s\n", tm->errMsg);
+    exit(1);
+  }
+  if ( batchflag )
+  { /* run to HALT without prompts */
+    if ( setupAt != NULL )
+    { if ( nIn == 0 ) inNames[nIn++] = NULL;
+      exitCode = setupRuns (inNames, nIn, forkflag);
+      runcnt = -1;
+    }
+    else
+    { exitCode = batchRun (inNames[0], &runcnt, &stepResult);
+      if ( exitCode < 0 ) exit(1);
+    }
+    if ( (profName != NULL) && ! tmProfileReport (tm, profName) )
+      fprintf(stderr, "%s\n", tm->errMsg);
+    if ( icountflag )
+    { if ( runcnt >= 0 )
+        fprintf(stderr,"Number of instructions executed = %ld\n",runcnt);
+      tmFuseReport (tm, stderr);
+    }
+    tmDestroy (tm);
+    free(inNames);
+    if ( (setupAt == NULL) && (exitCode != 0) )
+      fprintf(stderr,"%s\n",stepResultTab[stepResult]);
+    return exitCode;
+  }
+  /* switch input file to terminal */
+  /* reset( input ); */
+  tm->input = promptInput;
+  tm->output = printOutput;
+  /* read-eval-print */
+  printf("TM  simulation (enter h for help)...\n");
+  do
+     done = ! doCommand ();
+  while (! done );
+  if ( (profName != NULL) && ! tmProfileReport (tm, profName) )
+    fprintf(stderr, "%s\n", tm->errMsg);
+  tmFreeSnapshot (snap);
+  tmDestroy (tm);
+  free(inNames);
+  printf("Simulation done.\n");
+  return 0;
+}
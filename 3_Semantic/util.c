@@ -123,6 +123,55 @@ char * copyString(char * s)
   return t;
 }
 
+/* Function sourceLine returns the source line
+ * the code of tree is attributed to. If and
+ * while nodes carry the line their body ends
+ * on, so they take their test's line.
+ */
+int sourceLine( TreeNode * tree)
+{ if ((tree->nodekind == StmtK) && (tree->child[0] != NULL) &&
+      ((tree->kind.stmt == IfK) || (tree->kind.stmt == IfElseK) ||
+       (tree->kind.stmt == WhileK)))
+    return tree->child[0]->lineno;
+  return tree->lineno;
+}
+
+/* Function isSafeDivisor returns TRUE if a
+ * division by t cannot fault: t is a constant
+ * other than 0, and other than -1, which faults
+ * dividing the least integer
+ */
+int isSafeDivisor( TreeNode * t)
+{ return (t->nodekind == ExpK) && (t->kind.exp == ConstK) &&
+         (t->attr.val != 0) && (t->attr.val != -1);
+}
+
+/* Function sameExp returns TRUE if the pure
+ * expressions a and b are written alike, so
+ * they have the same value
+ */
+int sameExp( TreeNode * a, TreeNode * b)
+{ int i;
+  if ((a == NULL) || (b == NULL)) return a == b;
+  if ((a->nodekind != b->nodekind) || (a->kind.exp != b->kind.exp))
+    return FALSE;
+  switch (a->kind.exp) {
+    case ConstK :
+      return a->attr.val == b->attr.val;
+    case VarAccessK :
+      if (strcmp(a->attr.name,b->attr.name) != 0) return FALSE;
+      break;
+    case OpK :
+      if (a->attr.op != b->attr.op) return FALSE;
+      break;
+    default :
+      return FALSE;
+  }
+  for (i = 0; i < MAXCHILDREN; i++)
+    if (! sameExp(a->child[i],b->child[i])) return FALSE;
+  return TRUE;
+}
+
 /* Variable indentno is used by printTree to
  * store current number of spaces to indent
  */
@@ -28,6 +28,22 @@ TreeNode * newExpNode(ExpKind);
  */
 char * copyString( char * );
 
+/* Function sourceLine returns the source line
+ * the code of tree is attributed to by the code
+ * generators
+ */
+int sourceLine( TreeNode * );
+
+/* Function isSafeDivisor returns TRUE if a
+ * division by tree cannot fault
+ */
+int isSafeDivisor( TreeNode * );
+
+/* Function sameExp returns TRUE if two pure
+ * expressions are written alike
+ */
+int sameExp( TreeNode *, TreeNode * );
+
 /* procedure printTree prints a syntax tree to the 
  * listing file using indentation to indicate subtrees
  */
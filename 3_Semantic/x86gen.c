@@ -0,0 +1,662 @@
+/****************************************************/
+/* File: x86gen.c                                   */
+/* The code generator implementation for the        */
+/* C-MINUS compiler that generates GNU assembler    */
+/* code for x86-64 following the System V ABI, to   */
+/* be linked with the runtime cmrt.c                */
+/****************************************************/
+
+#include <stdarg.h>
+#include <limits.h>
+#include "globals.h"
+#include "util.h"
+#include "symtab.h"
+#include "x86gen.h"
+
+/* Stack frame layout (rbp-relative, in bytes):
+ *   16(rbp) = seventh argument, then the rest
+ *    8(rbp) = return address
+ *    0(rbp) = caller's rbp
+ *   below   = the first six arguments, copied
+ *             from their registers, then the
+ *             local variables
+ * Every scalar or array parameter takes an
+ * 8-byte slot, a declared array n*4 bytes
+ * rounded up to 8; memloc holds the offset of
+ * the slot or of element 0. Temporaries are
+ * pushed on the stack, and depth counts them so
+ * that calls are made with rsp 16-byte aligned.
+ * C-MINUS names get the prefix cm_, the labels
+ * of the code are .L<n>.
+ */
+#define WORD 8
+#define REG_ARGS 6
+
+static char * argReg64[REG_ARGS] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+static char * argReg32[REG_ARGS] = { "edi", "esi", "edx", "ecx", "r8d", "r9d" };
+
+/* frameOffset is the offset below rbp of the
+ * last slot allocated in the current frame
+ */
+static int frameOffset = 0;
+
+/* depth is the number of temporaries pushed */
+static int depth = 0;
+
+/* last label number used */
+static int labelNo = 0;
+
+/* TRUE once code jumps to the division by 0 exit */
+static int divZeroUsed = FALSE;
+
+/* TRUE once code jumps to the division overflow exit */
+static int divOverflowUsed = FALSE;
+
+/* source line of the code being generated, and
+ * of the last .loc directive
+ */
+static int locLine = 0;
+static int locEmitted = 0;
+
+/* scope of the code being generated */
+static ScopeList currentScope;
+
+/* prototypes for internal recursive code generator */
+static void genNode (TreeNode * tree);
+static void cGen (TreeNode * tree);
+
+/* Procedure emit writes one instruction or
+ * directive to the code file; an instruction
+ * for a new source line gets a .loc first
+ */
+static void emit( char * fmt, ...)
+{ va_list ap;
+  if ((fmt[0] != '.') && (locLine > 0) && (locLine != locEmitted))
+  { fprintf(code,"\t.loc 1 %d\n",locLine);
+    locEmitted = locLine;
+  }
+  va_start(ap,fmt);
+  fputc('\t',code);
+  vfprintf(code,fmt,ap);
+  fputc('\n',code);
+  va_end(ap);
+} /* emit */
+
+static void emitLabel( int label)
+{ fprintf(code,".L%d:\n",label); }
+
+static void emitComment( char * c)
+{ if (TraceCode) fprintf(code,"\t# %s\n",c); }
+
+/* Procedure emitLoc attributes the following
+ * code to source line lineno
+ */
+static void emitLoc( int lineno)
+{ if (lineno > 0) locLine = lineno;
+} /* emitLoc */
+
+/* Function slotSize returns the bytes taken in
+ * the frame by the variable declared at t
+ */
+static int slotSize( TreeNode * t)
+{ if ((t->kind.stmt == VarDeclK) && (t->child[0] != NULL))
+    return (t->child[0]->attr.val * 4 + WORD - 1) / WORD * WORD;
+  return WORD;
+} /* slotSize */
+
+/* Function localSize returns the bytes of frame
+ * needed by the local variables of the
+ * statement list t: nested compound statements
+ * are never active at once, so they share space
+ */
+static int localSize( TreeNode * t)
+{ int max = 0, size;
+  TreeNode * p;
+  for (; t != NULL; t = t->sibling)
+  { size = 0;
+    if (t->nodekind == StmtK)
+      switch (t->kind.stmt) {
+        case CompoundK :
+          for (p = t->child[0]; p != NULL; p = p->sibling)
+            size += slotSize(p);
+          size += localSize(t->child[1]);
+          break;
+        case IfK :
+        case IfElseK :
+          size = localSize(t->child[1]);
+          if (localSize(t->child[2]) > size)
+            size = localSize(t->child[2]);
+          break;
+        case WhileK :
+          size = localSize(t->child[1]);
+          break;
+        default :
+          break;
+      }
+    if (size > max) max = size;
+  }
+  return max;
+} /* localSize */
+
+/* Procedure genDecl allocates the variable
+ * declared at t: a global in .bss, a local in
+ * the frame
+ */
+static void genDecl( TreeNode * t)
+{ BucketList l = st_lookup(currentScope,t->attr.name);
+  int size = slotSize(t);
+  if (l->scope->parent == NULL)
+  { emit(".local cm_%s",l->name);
+    emit(".comm cm_%s,%d,%d",l->name,size,WORD);
+  }
+  else
+  { frameOffset -= size;
+    l->memloc = frameOffset;
+  }
+} /* genDecl */
+
+/* Function varOperand returns in buf the
+ * operand addressing the slot of variable l
+ */
+static char * varOperand( BucketList l, char * buf)
+{ if (l->scope->parent == NULL)
+    sprintf(buf,"cm_%s(%%rip)",l->name);
+  else
+    sprintf(buf,"%d(%%rbp)",l->memloc);
+  return buf;
+} /* varOperand */
+
+/* Function leafOperand returns in buf an operand
+ * for tree if it is a constant or a scalar
+ * variable, which need no code and have no side
+ * effects; NULL otherwise
+ */
+static char * leafOperand( TreeNode * tree, char * buf)
+{ BucketList l;
+  if (tree->nodekind != ExpK) return NULL;
+  if (tree->kind.exp == ConstK)
+  { sprintf(buf,"$%d",tree->attr.val);
+    return buf;
+  }
+  if ((tree->kind.exp == VarAccessK) && (tree->child[0] == NULL))
+  { l = st_lookup(currentScope,tree->attr.name);
+    if (l->type == Integer) return varOperand(l,buf);
+  }
+  return NULL;
+} /* leafOperand */
+
+/* Procedure genArrayBase loads the address of
+ * element 0 of array l into register reg
+ */
+static void genArrayBase( BucketList l, char * reg)
+{ char buf[80];
+  if (l->isParam)
+    emit("movq %s, %%%s",varOperand(l,buf),reg);
+  else
+    emit("leaq %s, %%%s",varOperand(l,buf),reg);
+} /* genArrayBase */
+
+/* Function elemOperand returns in buf the
+ * operand addressing the element of array l
+ * whose sign-extended index is in rcx; it may
+ * load the address of the array into rdx
+ */
+static char * elemOperand( BucketList l, char * buf)
+{ if ((l->scope->parent != NULL) && ! l->isParam)
+    sprintf(buf,"%d(%%rbp,%%rcx,4)",l->memloc);
+  else
+  { genArrayBase(l,"rdx");
+    sprintf(buf,"(%%rdx,%%rcx,4)");
+  }
+  return buf;
+} /* elemOperand */
+
+static void push( void)
+{ emit("pushq %%rax");
+  depth++;
+} /* push */
+
+static void pop( char * reg)
+{ emit("popq %%%s",reg);
+  depth--;
+} /* pop */
+
+/* Function relSuffix returns the condition code
+ * suffix of relational operator op, inverted
+ * when negate is TRUE; NULL if op is not
+ * relational
+ */
+static char * relSuffix( TokenType op, int negate)
+{ switch (op) {
+    case LT : return negate ? "ge" : "l";
+    case LE : return negate ? "g" : "le";
+    case GT : return negate ? "le" : "g";
+    case GE : return negate ? "l" : "ge";
+    case EQ : return negate ? "ne" : "e";
+    case NE : return negate ? "e" : "ne";
+    default : return NULL;
+  }
+} /* relSuffix */
+
+/* Procedure genCompare compares eax with right
+ * for relational operator op. As in TM, an order
+ * is the sign of the wrapped difference: testl
+ * clears the overflow flag, so the signed
+ * condition codes test the sign of eax.
+ */
+static void genCompare( TokenType op, char * right)
+{ if ((op == EQ) || (op == NE))
+    emit("cmpl %s, %%eax",right);
+  else
+  { emit("subl %s, %%eax",right);
+    emit("testl %%eax, %%eax");
+  }
+} /* genCompare */
+
+/* Function genOperands generates code leaving
+ * the left operand of the binary expression
+ * tree in eax and returns the operand holding
+ * the right one: itself if it is a leaf, else
+ * ecx. Left is evaluated before right, as in
+ * the TM code.
+ */
+static char * genOperands( TreeNode * tree, char * buf)
+{ char * right;
+  cGen(tree->child[0]);
+  right = leafOperand(tree->child[1],buf);
+  if (right == NULL)
+  { push();
+    cGen(tree->child[1]);
+    emit("movl %%eax, %%ecx");
+    pop("rax");
+    right = "%ecx";
+  }
+  return right;
+} /* genOperands */
+
+/* Procedure genCond generates code for the test
+ * expression tree jumping to label when its
+ * truth equals when. A relational test compiles
+ * to a compare and a conditional jump, so no
+ * 0/1 value is materialized.
+ */
+static void genCond( TreeNode * tree, int label, int when)
+{ char buf[80];
+  char * cc = NULL, * right;
+  if ((tree->nodekind == ExpK) && (tree->kind.exp == OpK))
+    cc = relSuffix(tree->attr.op,! when);
+  if (cc != NULL)
+  { emitComment("-> cond");
+    right = genOperands(tree,buf);
+    genCompare(tree->attr.op,right);
+    emit("j%s .L%d",cc,label);
+    emitComment("<- cond");
+  }
+  else
+  { cGen(tree);
+    emit("testl %%eax, %%eax");
+    emit("%s .L%d",when ? "jne" : "je",label);
+  }
+} /* genCond */
+
+/* Procedure genReturn generates the epilogue */
+static void genReturn(void)
+{ emit("leave");
+  emit("ret");
+} /* genReturn */
+
+/* Procedure genStmt generates code at a statement node */
+static void genStmt( TreeNode * tree)
+{ TreeNode * p1, * p2, * p3;
+  int label1, label2;
+  int savedOffset, size, n;
+  char buf[80];
+  BucketList l;
+  switch (tree->kind.stmt) {
+
+      case VarDeclK :
+         genDecl(tree);
+         break; /* VarDeclK */
+
+      case FuncDeclK :
+         emitComment("-> function");
+         l = st_lookup(currentScope,tree->attr.name);
+         fputc('\n',code);
+         emit(".globl cm_%s",l->name);
+         emit(".type cm_%s, @function",l->name);
+         fprintf(code,"cm_%s:\n",l->name);
+         currentScope = findScope(tree,currentScope);
+         frameOffset = 0;
+         depth = 0;
+         /* the first arguments are stored below rbp,
+          * the others are already above it
+          */
+         n = 0;
+         size = 0;
+         for (p1 = tree->child[0]; p1 != NULL; p1 = p1->sibling)
+           if (p1->kind.stmt == ParamK)
+           { if (n < REG_ARGS) size += WORD;
+             n++;
+           }
+         /* the body shares the function scope */
+         p2 = tree->child[1];
+         for (p1 = p2->child[0]; p1 != NULL; p1 = p1->sibling)
+           size += slotSize(p1);
+         size += localSize(p2->child[1]);
+         size = (size + 15) / 16 * 16;
+         emitLoc(tree->lineno);
+         emit("pushq %%rbp");
+         emit("movq %%rsp, %%rbp");
+         if (size > 0) emit("subq $%d, %%rsp",size);
+         n = 0;
+         for (p1 = tree->child[0]; p1 != NULL; p1 = p1->sibling)
+           if (p1->kind.stmt == ParamK)
+           { l = st_lookup(currentScope,p1->attr.name);
+             if (n < REG_ARGS)
+             { genDecl(p1);
+               emit("movq %%%s, %s",argReg64[n],varOperand(l,buf));
+             }
+             else
+               l->memloc = 2 * WORD + (n - REG_ARGS) * WORD;
+             n++;
+           }
+         for (p1 = p2->child[0]; p1 != NULL; p1 = p1->sibling)
+           genDecl(p1);
+         cGen(p2->child[1]);
+         genReturn();
+         emit(".size cm_%s, .-cm_%s",tree->attr.name,tree->attr.name);
+         currentScope = currentScope->parent;
+         emitComment("<- function");
+         break; /* FuncDeclK */
+
+      case CompoundK :
+         emitComment("-> compound");
+         currentScope = findScope(tree,currentScope);
+         savedOffset = frameOffset;
+         cGen(tree->child[0]);
+         cGen(tree->child[1]);
+         frameOffset = savedOffset;
+         currentScope = currentScope->parent;
+         emitComment("<- compound");
+         break; /* CompoundK */
+
+      case IfK :
+      case IfElseK :
+         emitComment("-> if");
+         p1 = tree->child[0] ;
+         p2 = tree->child[1] ;
+         p3 = tree->child[2] ;
+         label1 = ++labelNo;
+         genCond(p1,label1,FALSE);
+         cGen(p2);
+         if (p3 != NULL)
+         { label2 = ++labelNo;
+           emit("jmp .L%d",label2);
+           emitLabel(label1);
+           cGen(p3);
+           emitLabel(label2);
+         }
+         else
+           emitLabel(label1);
+         emitComment("<- if");
+         break; /* if_k */
+
+      case WhileK:
+         emitComment("-> while");
+         p1 = tree->child[0] ;
+         p2 = tree->child[1] ;
+         /* the test is at the bottom, entered by a
+          * jump, so each iteration takes one branch
+          */
+         label1 = ++labelNo;
+         label2 = ++labelNo;
+         emit("jmp .L%d",label2);
+         emitLabel(label1);
+         cGen(p2);
+         emitLabel(label2);
+         genCond(p1,label1,TRUE);
+         emitComment("<- while");
+         break; /* while */
+
+      case ReturnK:
+         emitComment("-> return");
+         cGen(tree->child[0]);
+         genReturn();
+         emitComment("<- return");
+         break; /* return */
+
+      default:
+         break;
+    }
+} /* genStmt */
+
+/* Procedure genCall generates code for the call
+ * tree. The arguments are evaluated left to
+ * right and pushed, then moved to the argument
+ * registers and the stack slots reserved for
+ * the seventh and later ones.
+ */
+static void genCall( TreeNode * tree)
+{ TreeNode * p;
+  char buf[80];
+  int n = 0, i, reserved, leaves = TRUE;
+  for (p = tree->child[0]; p != NULL; p = p->sibling)
+  { if (leafOperand(p,buf) == NULL) leaves = FALSE;
+    n++;
+  }
+  if (leaves && (n <= REG_ARGS))
+  { /* constants and scalars load directly */
+    for (i = 0, p = tree->child[0]; p != NULL; i++, p = p->sibling)
+      emit("movl %s, %%%s",leafOperand(p,buf),argReg32[i]);
+    if (depth % 2 != 0) emit("subq $8, %%rsp");
+    emit("call cm_%s",tree->attr.name);
+    if (depth % 2 != 0) emit("addq $8, %%rsp");
+    return;
+  }
+  reserved = (n > REG_ARGS) ? n - REG_ARGS : 0;
+  reserved += (depth + reserved) % 2;
+  if (reserved > 0)
+  { emit("subq $%d, %%rsp",reserved * WORD);
+    depth += reserved;
+  }
+  for (p = tree->child[0]; p != NULL; p = p->sibling)
+  { genNode(p);
+    push();
+  }
+  /* argument i was pushed at (n-1-i)*8(rsp) */
+  for (i = REG_ARGS; i < n; i++)
+  { emit("movq %d(%%rsp), %%rax",(n - 1 - i) * WORD);
+    emit("movq %%rax, %d(%%rsp)",(n + i - REG_ARGS) * WORD);
+  }
+  if (n <= REG_ARGS)
+    for (i = n - 1; i >= 0; i--)
+      pop(argReg64[i]);
+  else
+  { for (i = 0; i < REG_ARGS; i++)
+      emit("movq %d(%%rsp), %%%s",(n - 1 - i) * WORD,argReg64[i]);
+    emit("addq $%d, %%rsp",n * WORD);
+    depth -= n;
+  }
+  emit("call cm_%s",tree->attr.name);
+  if (reserved > 0)
+  { emit("addq $%d, %%rsp",reserved * WORD);
+    depth -= reserved;
+  }
+} /* genCall */
+
+/* Procedure genExp generates code at an expression node */
+static void genExp( TreeNode * tree)
+{ TreeNode * p1, * p2;
+  BucketList l;
+  char buf[80], elem[80];
+  char * right, * cc;
+  int label;
+  switch (tree->kind.exp) {
+
+    case ConstK :
+      emit("movl $%d, %%eax",tree->attr.val);
+      break; /* ConstK */
+
+    case VarAccessK :
+      l = st_lookup(currentScope,tree->attr.name);
+      if (tree->child[0] != NULL)
+      { cGen(tree->child[0]);
+        emit("movslq %%eax, %%rcx");
+        emit("movl %s, %%eax",elemOperand(l,elem));
+      }
+      else if (l->type == IntegerArr)
+        genArrayBase(l,"rax");
+      else
+        emit("movl %s, %%eax",varOperand(l,buf));
+      break; /* VarAccessK */
+
+    case AssignK :
+      emitComment("-> assign");
+      p1 = tree->child[0];
+      p2 = tree->child[1];
+      l = st_lookup(currentScope,p1->attr.name);
+      if (p1->child[0] != NULL)
+      { cGen(p1->child[0]);
+        if ((right = leafOperand(p2,buf)) != NULL)
+        { emit("movslq %%eax, %%rcx");
+          emit("movl %s, %%eax",right);
+        }
+        else
+        { push();
+          cGen(p2);
+          pop("rcx");
+          emit("movslq %%ecx, %%rcx");
+        }
+        emit("movl %%eax, %s",elemOperand(l,elem));
+      }
+      else
+      { cGen(p2);
+        emit("movl %%eax, %s",varOperand(l,buf));
+      }
+      emitComment("<- assign");
+      break; /* AssignK */
+
+    case CallK :
+      emitComment("-> call");
+      genCall(tree);
+      emitComment("<- call");
+      break; /* CallK */
+
+    case OpK :
+      right = genOperands(tree,buf);
+      switch (tree->attr.op) {
+        case PLUS :
+          emit("addl %s, %%eax",right);
+          break;
+        case MINUS :
+          emit("subl %s, %%eax",right);
+          break;
+        case TIMES :
+          emit("imull %s, %%eax",right);
+          break;
+        case OVER :
+          if (right[0] == '$')
+          { if (tree->child[1]->attr.val == 0)
+            { emit("jmp .Ldivzero");
+              divZeroUsed = TRUE;
+            }
+            else if (tree->child[1]->attr.val == -1)
+            { emit("cmpl $%d, %%eax",INT_MIN);
+              emit("je .Ldivoverflow");
+              divOverflowUsed = TRUE;
+            }
+            emit("movl %s, %%ecx",right);
+          }
+          else
+          { if (strcmp(right,"%ecx") != 0) emit("movl %s, %%ecx",right);
+            emit("testl %%ecx, %%ecx");
+            emit("je .Ldivzero");
+            divZeroUsed = TRUE;
+            label = ++labelNo;
+            emit("cmpl $-1, %%ecx");
+            emit("jne .L%d",label);
+            emit("cmpl $%d, %%eax",INT_MIN);
+            emit("je .Ldivoverflow");
+            emitLabel(label);
+            divOverflowUsed = TRUE;
+          }
+          emit("cltd");
+          emit("idivl %%ecx");
+          break;
+        default:
+          cc = relSuffix(tree->attr.op,FALSE);
+          if (cc == NULL)
+          { emitComment("BUG: Unknown operator");
+            break;
+          }
+          genCompare(tree->attr.op,right);
+          emit("set%s %%al",cc);
+          emit("movzbl %%al, %%eax");
+          break;
+      } /* case op */
+      break; /* OpK */
+
+    default:
+      break;
+  }
+} /* genExp */
+
+/* Procedure genNode generates code for the node
+ * tree and its children, but not its siblings
+ */
+static void genNode( TreeNode * tree)
+{ int savedLine = locLine;
+  emitLoc(sourceLine(tree));
+  switch (tree->nodekind) {
+    case StmtK:
+      genStmt(tree);
+      break;
+    case ExpK:
+      genExp(tree);
+      break;
+    default:
+      break;
+  }
+  locLine = savedLine;
+} /* genNode */
+
+/* Procedure cGen recursively generates code by
+ * tree traversal
+ */
+static void cGen( TreeNode * tree)
+{ for (; tree != NULL; tree = tree->sibling)
+    genNode(tree);
+}
+
+/**********************************************/
+/* the primary function of the code generator */
+/**********************************************/
+/* Procedure x86Gen generates GNU assembler code
+ * for x86-64 to the code file by traversal of
+ * the syntax tree. codefile is the name of the
+ * code file and srcfile the name of the source,
+ * for the line table.
+ */
+void x86Gen(TreeNode * syntaxTree, char * codefile, char * srcfile)
+{  extern ScopeList globalScope;
+   fprintf(code,"# C-MINUS Compilation to x86-64 Code\n");
+   fprintf(code,"# File: %s\n",codefile);
+   emit(".file \"%s\"",srcfile);
+   emit(".file 1 \"%s\"",srcfile);
+   emit(".text");
+   /* generate code for C-MINUS program */
+   currentScope = globalScope;
+   cGen(syntaxTree);
+   if (divZeroUsed)
+   { /* may be reached with temporaries pushed */
+     fprintf(code,"\n.Ldivzero:\n");
+     emit("andq $-16, %%rsp");
+     emit("call cm_divzero");
+   }
+   if (divOverflowUsed)
+   { fprintf(code,"\n.Ldivoverflow:\n");
+     emit("andq $-16, %%rsp");
+     emit("call cm_divoverflow");
+   }
+   emit(".section .note.GNU-stack,\"\",@progbits");
+}
@@ -0,0 +1,19 @@
+/*******************************************************/
+/* File: x86gen.h                                      */
+/* The x86-64 code generator interface to the C-MINUS  */
+/* compiler                                            */
+/*******************************************************/
+
+#ifndef _X86GEN_H_
+#define _X86GEN_H_
+
+/* Procedure x86Gen generates GNU assembler code
+ * for x86-64 (System V ABI) to the code file by
+ * traversal of the syntax tree. codefile is the
+ * name of the code file and srcfile the name of
+ * the source, for the line table. The code is
+ * linked with the runtime cmrt.c.
+ */
+void x86Gen(TreeNode * syntaxTree, char * codefile, char * srcfile);
+
+#endif